@@ -90,7 +90,7 @@ void alert_tracker_finalize(AlertTracker *at, const Time *time) {
     at->fatal_error &= !clear_fatal;
 }
 
-bool alert_tracker_is_alert_active(AlertTracker *at, AlertId alert) {
+bool alert_tracker_is_alert_active(const AlertTracker *at, AlertId alert) {
     return at->active_alert_mask & alert_id_to_mask(alert);
 }
 
@@ -68,6 +68,6 @@ void alert_tracker_add(AlertTracker *at, const Time *time, uint8_t id, uint8_t d
 
 void alert_tracker_finalize(AlertTracker *at, const Time *time);
 
-bool alert_tracker_is_alert_active(AlertTracker *at, AlertId alert);
+bool alert_tracker_is_alert_active(const AlertTracker *at, AlertId alert);
 
 void alert_tracker_clear_fatal(AlertTracker *at);
@@ -0,0 +1,63 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include "command_queue.h"
+
+#include "time.h"
+
+#include <string.h>
+
+_Static_assert(
+    (COMMAND_QUEUE_SIZE & (COMMAND_QUEUE_SIZE - 1)) == 0 && COMMAND_QUEUE_SIZE <= 128,
+    "COMMAND_QUEUE_SIZE needs to be a power of two for the uint8_t indices to wrap around."
+);
+
+void command_queue_init(CommandQueue *q) {
+    q->head = 0;
+    q->tail = 0;
+    q->dropped = 0;
+}
+
+bool command_queue_push(CommandQueue *q, uint8_t command, const uint8_t *data, size_t len) {
+    uint8_t head = q->head;
+    uint8_t tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+    if ((uint8_t) (head - tail) >= COMMAND_QUEUE_SIZE || len > QUEUED_COMMAND_DATA_MAX) {
+        ++q->dropped;
+        return false;
+    }
+
+    QueuedCommand *c = &q->items[head % COMMAND_QUEUE_SIZE];
+    c->command = command;
+    c->len = len;
+    memcpy(c->data, data, len);
+    c->queued_time = vesc_system_time_ticks();
+
+    __atomic_store_n(&q->head, (uint8_t) (head + 1), __ATOMIC_RELEASE);
+    return true;
+}
+
+QueuedCommand *command_queue_front(CommandQueue *q) {
+    uint8_t tail = q->tail;
+    if (__atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == tail) {
+        return NULL;
+    }
+    return &q->items[tail % COMMAND_QUEUE_SIZE];
+}
+
+void command_queue_pop(CommandQueue *q) {
+    __atomic_store_n(&q->tail, (uint8_t) (q->tail + 1), __ATOMIC_RELEASE);
+}
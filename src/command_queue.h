@@ -0,0 +1,69 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "vesc_c_if.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define COMMAND_QUEUE_SIZE 8
+#define QUEUED_COMMAND_DATA_MAX 32
+
+typedef struct {
+    uint8_t command;
+    uint8_t len;
+    uint8_t data[QUEUED_COMMAND_DATA_MAX];
+    systime_t queued_time;  // in system ticks
+} QueuedCommand;
+
+// A bounded lock-free queue of commands for a single producer and a single
+// consumer (the aux thread). The commands arrive in the threads of the
+// different interfaces, the pushes need to be serialized by the caller (by the
+// command lock in main.c), so that there's only one producer at a time.
+//
+// The head index is only written by the producer and the tail index only by
+// the consumer, each published after the item has been written or read.
+typedef struct {
+    QueuedCommand items[COMMAND_QUEUE_SIZE];
+    uint8_t head;  // atomic
+    uint8_t tail;  // atomic
+    uint16_t dropped;  // only accessed by the producer
+} CommandQueue;
+
+void command_queue_init(CommandQueue *q);
+
+/**
+ * Pushes a command into the queue. Returns false if the queue is full or the
+ * data is too long. Calls must be serialized, see above.
+ */
+bool command_queue_push(CommandQueue *q, uint8_t command, const uint8_t *data, size_t len);
+
+/**
+ * Returns the oldest command in the queue, or NULL if it's empty. The command
+ * stays in the queue until it's popped. Must only be called from the consumer
+ * thread.
+ */
+QueuedCommand *command_queue_front(CommandQueue *q);
+
+/**
+ * Removes the oldest command from the queue. Must only be called from the
+ * consumer thread after a successful command_queue_front().
+ */
+void command_queue_pop(CommandQueue *q);
@@ -30,7 +30,7 @@
 // Precision: 3.311 decimal digits
 //
 // https://stackoverflow.com/a/60047308
-uint16_t to_float16(float x) {
+uint16_t to_float16_sw(float x) {
     // round-to-nearest-even: add last bit after truncated mantissa
     const uint32_t b = *(uint32_t*)&x +0x00001000;
     const uint32_t e = (b&0x7F800000)>>23; // exponent
@@ -43,6 +43,63 @@ uint16_t to_float16(float x) {
 // clang-format on
 #pragma GCC diagnostic pop
 
+#ifndef FLOAT16_HW
+uint16_t to_float16(float x) {
+    return to_float16_sw(x);
+}
+
+void to_float16_array(uint16_t *dst, const float *src, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = to_float16_sw(src[i]);
+    }
+}
+#else
+// Hardware conversion by the VCVTB instruction. The format above matches the
+// ARM alternative half-precision format (no Inf/NaN, exponent 31 used for
+// normal numbers), selected by the AHP bit in FPSCR. The IEEE format
+// (-mfp16-format=ieee) would turn values over 65504 into Inf, so instead of
+// __fp16 the instruction is used directly, with AHP set only for the duration
+// of the conversion (FPSCR is per-thread and the recorder runs in the IMU
+// thread of the firmware).
+//
+// Differences to the software conversion: Ties round to even and NaN converts
+// to 0 (instead of the maximum).
+#define FPSCR_AHP (1u << 26)
+
+static inline uint32_t fpscr_set_ahp() {
+    uint32_t fpscr;
+    __asm__ volatile("vmrs %0, fpscr" : "=r"(fpscr));
+    __asm__ volatile("vmsr fpscr, %0" : : "r"(fpscr | FPSCR_AHP));
+    return fpscr;
+}
+
+static inline void fpscr_restore(uint32_t fpscr) {
+    __asm__ volatile("vmsr fpscr, %0" : : "r"(fpscr));
+}
+
+static inline uint16_t vcvtb_f16_f32(float x) {
+    uint32_t result;
+    // volatile to keep it between the FPSCR accesses
+    __asm__ volatile("vcvtb.f16.f32 %1, %1\n\tvmov %0, %1" : "=r"(result), "+t"(x));
+    return result;
+}
+
+uint16_t to_float16(float x) {
+    uint32_t fpscr = fpscr_set_ahp();
+    uint16_t result = vcvtb_f16_f32(x);
+    fpscr_restore(fpscr);
+    return result;
+}
+
+void to_float16_array(uint16_t *dst, const float *src, size_t count) {
+    uint32_t fpscr = fpscr_set_ahp();
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = vcvtb_f16_f32(src[i]);
+    }
+    fpscr_restore(fpscr);
+}
+#endif
+
 void buffer_append_int16(uint8_t *buffer, int16_t number, int32_t *index) {
     buffer[(*index)++] = number >> 8;
     buffer[(*index)++] = number;
@@ -18,9 +18,19 @@
 #ifndef BUFFER_H_
 #define BUFFER_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
+// float16 conversion by the VCVTB instruction if the FPU supports it
+#if defined(__ARM_FP) && (__ARM_FP & 0x2)
+#define FLOAT16_HW
+#endif
+
 uint16_t to_float16(float x);
+// the software conversion, used when FLOAT16_HW is not available (and as the
+// reference for the hardware conversion in tests)
+uint16_t to_float16_sw(float x);
+void to_float16_array(uint16_t *dst, const float *src, size_t count);
 
 void buffer_append_int16(uint8_t *buffer, int16_t number, int32_t *index);
 void buffer_append_uint16(uint8_t *buffer, uint16_t number, int32_t *index);
@@ -47,6 +47,13 @@ typedef enum {
     LED_PIN_LAST = LED_PIN_C9
 } LedPin;
 
+typedef enum {
+    LED_STRIP_PIN_DEFAULT = 0,
+    LED_STRIP_PIN_B6,
+    LED_STRIP_PIN_B7,
+    LED_STRIP_PIN_C9
+} LedStripPin;
+
 typedef enum {
     LED_PIN_CFG_PULLUP_TO_5V = 0,
     LED_PIN_CFG_NO_PULLUP
@@ -111,6 +118,8 @@ typedef enum {
     LED_ANIM_RAINBOW_CYCLE,
     LED_ANIM_RAINBOW_FADE,
     LED_ANIM_RAINBOW_ROLL,
+    LED_ANIM_PROGRAM_1,
+    LED_ANIM_PROGRAM_2,
 } LedAnimMode;
 
 typedef enum {
@@ -157,9 +166,10 @@ typedef struct {
 
 typedef struct {
     LedStripOrder order;
-    uint8_t count;
+    uint16_t count;
     LedColorOrder color_order;
     bool reverse;
+    LedStripPin pin;
 } CfgLedStrip;
 
 typedef struct {
@@ -174,6 +184,7 @@ typedef struct {
 typedef struct {
     CfgHwLeds leds;
     bool swap_footpad_adcs;
+    uint8_t data_record_buffer_size;
 } CfgHardware;
 
 typedef struct {
@@ -23,6 +23,7 @@
 #include "booster.h"
 #include "brake_tilt.h"
 #include "charging.h"
+#include "command_queue.h"
 #include "data_record.h"
 #include "filters/ema.h"
 #include "footpad_sensor.h"
@@ -37,18 +38,71 @@
 #include "pid.h"
 #include "remote.h"
 #include "reverse_stop.h"
+#include "ride_stats.h"
 #include "state.h"
 #include "time.h"
 #include "torque_tilt.h"
+#include "tune_profiles.h"
 #include "turn_tilt.h"
 
+#include "lib/utils.h"
+
 #include <vesc_c_if.h>
 
+// seconds without a keepalive after which the subscription is cancelled
+#define REALTIME_DATA_SUBSCRIPTION_TIMEOUT 5
+// every Nth frame of a delta subscription is a keyframe containing all items
+#define REALTIME_DATA_KEYFRAME_INTERVAL 30
+
+#define REALTIME_DATA_ITEMS_MAX 64
+
+// Precomputed serialization plan of REALTIME_DATA for a pair of masks: the
+// indices of the items to serialize, in order.
+typedef struct {
+    uint32_t mask1;
+    uint32_t mask2;
+    uint8_t count;
+    uint8_t items[REALTIME_DATA_ITEMS_MAX];
+} RealtimeDataPlan;
+
+// Subscription of a client to REALTIME_DATA frames, pushed from the aux thread.
+typedef struct {
+    bool active;
+    uint8_t control_flags;
+    RealtimeDataPlan plan;
+    time_t period;  // in ticks
+    uint8_t timeout;  // in seconds
+    uint16_t seq;
+    time_t frame_timer;
+    time_t keepalive_timer;
+
+    // delta frames: the item values sent in the previous frame, indexed by
+    // the bit position in the masks (mask2 bits offset by 32)
+    bool keyframe_requested;
+    float last_values[REALTIME_DATA_ITEMS_MAX];
+} RealtimeDataSubscription;
+
+// Reply of a BATCH command being assembled. While active, the responses of
+// the sub-commands are collected into the buffer instead of being sent. Only
+// used with the command lock held.
+typedef struct {
+    bool active;
+    uint8_t command;  // the sub-command being processed
+    uint8_t status;  // status flags of the sub-command being processed
+    int32_t ind;
+    uint8_t buffer[SEND_BUF_MAX_SIZE];
+} CommandBatch;
+
 typedef struct {
     lib_thread main_thread;
     lib_thread aux_thread;
 
     RefloatConfig float_conf;
+    // the serialized config as last read from or written to the EEPROM, for
+    // writing only the changed words, and its CRC word; only accessed by the
+    // aux thread (the config writes are all queued to it)
+    uint32_t *cfg_eeprom_image;
+    uint32_t cfg_eeprom_crc;
 
     // Firmware version, passed in from Lisp
     int fw_version_major, fw_version_minor, fw_version_beta;
@@ -81,6 +135,16 @@ typedef struct {
     BMS bms;
 
     DataRecord data_record;
+    RideStats ride_stats;
+    RealtimeDataPlan rt_plan;  // cached plan of the last REALTIME_DATA request
+    RealtimeDataSubscription rt_subscription;
+    // held while running an app command, serializes the commands received
+    // from different interfaces (threads)
+    lib_mutex command_lock;
+    CommandBatch command_batch;
+    CommandQueue command_queue;
+    uint32_t reconfigure_pending;  // RECONF_* flags of components to reconfigure
+    TuneProfiles tune_profiles;
 
     Konami flywheel_konami;
     Konami headlights_on_konami;
@@ -17,31 +17,117 @@
 
 #pragma once
 
-#include "lib/circular_buffer.h"
+#include "lib/seq_buffer.h"
 #include "rt_data.h"
 #include "time.h"
 
 #include <stdbool.h>
 #include <stdint.h>
 
+// Any of the realtime data items can be recorded, the selection is a bitmask
+// indexed by the position of the item in RT_DATA_ALL_ITEMS (which is the order
+// of the IDs sent in REALTIME_DATA_INTERNAL_IDS).
+#define DATA_RECORD_CHANNELS_MAX ITEMS_COUNT(RT_DATA_ALL_ITEMS)
+
+// How samples are reduced when decimating.
+typedef enum {
+    // record every Nth sample, one value per channel
+    DR_DECIMATION_SKIP = 0,
+    // record the minimum and maximum of each channel over the N samples, two
+    // values (min, max) per channel
+    DR_DECIMATION_ENVELOPE = 1,
+} DataRecordDecimationMode;
+
+// A sample with room for all channels. Only the first channel_count (times two
+// in envelope mode) values are stored in the buffer.
 typedef struct {
     time_t time;
     uint8_t flags;
-    uint16_t values[ITEMS_COUNT_REC(RT_DATA_ALL_ITEMS)];  // values encoded as float16
+    uint16_t values[2 * DATA_RECORD_CHANNELS_MAX];  // values encoded as float16
 } Sample;
 
+// Events which can trigger freezing the recording in trigger mode.
+typedef enum {
+    DR_TRIGGER_NONE = 0,
+    DR_TRIGGER_STOP = 1 << 0,  // any stop condition (state_stop())
+    DR_TRIGGER_FW_FAULT = 1 << 1,  // ALERT_FW_FAULT
+    DR_TRIGGER_WHEELSLIP = 1 << 2,
+    DR_TRIGGER_PUSHBACK = 1 << 3,  // any of the SAT_PB_* pushbacks
+} DataRecordTrigger;
+
+// State of a windowed bulk transfer of the recorded data. The transfer is split
+// into packets of a fixed number of samples, at most window packets are sent
+// ahead of the last acknowledged one.
+typedef struct {
+    uint32_t offset;  // first sample of the transfer, relative to the header
+    uint32_t count;  // number of samples in the transfer
+    uint16_t packets;
+    uint16_t next_packet;
+    uint16_t acked_packets;
+    uint8_t window;
+    uint8_t samples_per_packet;
+} DataRecordBulk;
+
 typedef struct {
     bool enabled;
+    // cleared while the sample layout is being changed, atomic
+    bool sampling;
+    // set by the IMU thread while in data_recorder_sample(), atomic
+    bool in_sample;
     bool recording;
     bool autostart;
     bool autostop;
     uint8_t decimation;
     uint8_t decimation_counter;
     uint16_t sample_rate;
-    uint16_t sample_count;
+    uint32_t sample_count;
+
+    // bitmask of the recorded items and the offsets of the selected items in
+    // the Data struct, precomputed when the selection changes
+    uint32_t channel_mask;
+    uint8_t channel_count;
+    uint16_t channel_offsets[DATA_RECORD_CHANNELS_MAX];
+
+    // per-channel min/max accumulated over the decimation block in envelope mode
+    DataRecordDecimationMode decimation_mode;
+    float envelope_min[DATA_RECORD_CHANNELS_MAX];
+    float envelope_max[DATA_RECORD_CHANNELS_MAX];
+
+    // Trigger mode: When trigger_mask is non-zero, the buffer records
+    // continuously and on one of the trigger events, post_trigger_samples
+    // more samples are recorded and then the recording is frozen. The
+    // capture is kept until it's fetched by a client.
+    uint8_t trigger_mask;
+    uint32_t post_trigger_samples;
+    uint32_t post_trigger_recorded;
+    uint8_t trigger_events;  // trigger events active on the last check, for edge detection
+    uint8_t trigger_reason;  // the DataRecordTrigger which froze the capture
+    uint8_t trigger_detail;  // stop condition, SAT or fault code, depending on the reason
+    bool capture_fetched;
+
     // timestamp of the last recorded sample, used to keep timestamps strictly
     // increasing (the system tick is too coarse to distinguish samples at high
     // IMU rates, where several samples can share a tick)
     time_t last_time;
-    CircularBuffer buffer;
+
+    // the sample being assembled by data_recorder_sample(), kept here instead
+    // of on the stack of the IMU callback (only accessed by the IMU thread)
+    float staging_values[2 * DATA_RECORD_CHANNELS_MAX];
+    Sample staging_sample;
+
+    uint8_t *buffer_memory;
+    size_t buffer_size;
+    // true if buffer_memory was allocated from the package memory (stock firmware)
+    bool buffer_allocated;
+    // The buffer is written from the IMU thread and read from the command
+    // thread without locking, see SeqBuffer.
+    SeqBuffer buffer;
+    // sequence number of the first sample of the current recording
+    uint32_t start_seq;
+    // the range of samples described by the last sent header, which the
+    // offsets in data requests are relative to
+    uint32_t header_seq;
+    uint32_t header_size;
+
+    DataRecordBulk bulk;
 } DataRecord;
@@ -20,10 +20,48 @@
 #include "lib/utils.h"
 #include "vesc_c_if.h"
 
+#include <stddef.h>
+#include <string.h>
+
+_Static_assert(DATA_RECORD_CHANNELS_MAX <= 32, "Recorded items don't fit into the channel mask.");
+
+#define ITEM_OFFSET(target, id) offsetof(Data, target),
+static const uint16_t item_offsets[] = {VISIT(RT_DATA_ALL_ITEMS, ITEM_OFFSET)};
+#undef ITEM_OFFSET
+
+#define ITEM_ID(target, id) id,
+static const char *const item_ids[] = {VISIT(RT_DATA_ALL_ITEMS, ITEM_ID)};
+#undef ITEM_ID
+
+// The R items from rt_data.h are recorded by default
+#define ITEM_SEND(target, id) false,
+#define ITEM_REC(target, id) true,
+static const bool item_recorded_by_default[] = {RT_DATA_ALL_ITEMS(ITEM_SEND, ITEM_REC)};
+#undef ITEM_SEND
+#undef ITEM_REC
+
+// Number of values stored in a sample
+static uint8_t value_count(const DataRecord *dr) {
+    return dr->decimation_mode == DR_DECIMATION_ENVELOPE ? 2 * dr->channel_count
+                                                         : dr->channel_count;
+}
+
+static size_t sample_size(const DataRecord *dr) {
+    return offsetof(Sample, values) + value_count(dr) * sizeof(uint16_t);
+}
+
 static void start_recording(DataRecord *dr) {
-    circular_buffer_clear(&dr->buffer);
+    // samples are never removed from the buffer by the consumer, just start
+    // the new recording at the current head
+    dr->start_seq = seq_buffer_head(&dr->buffer);
     dr->decimation_counter = 0;
     dr->last_time = 0;
+    // events already active when starting must not trigger
+    dr->trigger_events = 0xff;
+    dr->trigger_reason = DR_TRIGGER_NONE;
+    dr->trigger_detail = 0;
+    dr->post_trigger_recorded = 0;
+    dr->capture_fetched = false;
     dr->recording = true;
 }
 
@@ -31,19 +69,55 @@ static void stop_recording(DataRecord *dr) {
     dr->recording = false;
 }
 
+// Sets the recorded channels and the decimation mode, which determine the
+// layout of the samples in the buffer.
+static bool set_channels(DataRecord *dr, uint32_t mask, DataRecordDecimationMode mode) {
+    mask &= (1ull << DATA_RECORD_CHANNELS_MAX) - 1;
+    if (mask == 0) {
+        return false;
+    }
+
+    // Changing the sample layout invalidates the recorded data. Disable
+    // sampling and wait for a data_recorder_sample() call possibly in progress
+    // to finish before rebuilding the layout under it. Both sides store their
+    // flag before loading the other's (sequentially consistent), so either
+    // the sampler sees sampling cleared or this sees it in_sample.
+    __atomic_store_n(&dr->sampling, false, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&dr->in_sample, __ATOMIC_SEQ_CST)) {
+        VESC_IF->sleep_us(100);
+    }
+    stop_recording(dr);
+
+    dr->decimation_mode = mode;
+    dr->channel_mask = mask;
+    dr->channel_count = 0;
+    for (uint8_t i = 0; i < DATA_RECORD_CHANNELS_MAX; ++i) {
+        if (mask & (1u << i)) {
+            dr->channel_offsets[dr->channel_count++] = item_offsets[i];
+        }
+    }
+
+    size_t size = sample_size(dr);
+    seq_buffer_init(&dr->buffer, size, dr->buffer_size / size, dr->buffer_memory);
+    dr->sample_count = seq_buffer_capacity(&dr->buffer);
+    dr->start_seq = 0;
+    dr->header_seq = 0;
+    dr->header_size = 0;
+    dr->post_trigger_samples = min(dr->post_trigger_samples, dr->sample_count);
+
+    // publish the new layout to the IMU thread
+    __atomic_store_n(&dr->sampling, true, __ATOMIC_RELEASE);
+    return true;
+}
+
 typedef struct {
     uint32_t magic;
     uint8_t *buffer;
     size_t length;
 } DataBufferInfo;
 
-void data_recorder_init(DataRecord *dr, uint16_t imu_sample_rate) {
-    dr->recording = false;
-    dr->autostart = true;
-    dr->autostop = true;
-    dr->decimation_counter = 0;
-    dr->last_time = 0;
-
+// Finds the static buffer provided by the custom firmware.
+static bool find_firmware_buffer(DataRecord *dr) {
     // fetch information about the data buffer, it's stored at the end of the
     // VESC interface memory area
     DataBufferInfo *buffer_info = (DataBufferInfo *) ((uint8_t *) VESC_IF + 2036);
@@ -60,22 +134,90 @@ void data_recorder_init(DataRecord *dr, uint16_t imu_sample_rate) {
         if (buffer_info->magic != 0) {
             log_msg("Data Record incompatible magic: 0x%08x", buffer_info->magic);
         }
+        return false;
+    }
+
+    dr->buffer_memory = buffer_info->buffer;
+    dr->buffer_size = buffer_info->length;
+    return true;
+}
+
+// Package memory left free after allocating the fallback buffer, for the
+// allocations done later at runtime (config, LED data on reconfiguration etc.)
+#define FALLBACK_MEMORY_RESERVE 8192
+#define FALLBACK_SIZE_MIN 2048
+
+// Allocates the buffer from the package memory, which is shared with LispBM
+// and there's no way to query the free amount. Probe by halving the size
+// until the buffer plus the reserve fits.
+static bool allocate_fallback_buffer(DataRecord *dr, uint8_t size_kb) {
+    size_t size = (size_t) size_kb * 1024;
+    while (size >= FALLBACK_SIZE_MIN) {
+        void *probe = VESC_IF->malloc(size + FALLBACK_MEMORY_RESERVE);
+        if (probe) {
+            VESC_IF->free(probe);
+            dr->buffer_memory = VESC_IF->malloc(size);
+            if (dr->buffer_memory) {
+                dr->buffer_size = size;
+                dr->buffer_allocated = true;
+                return true;
+            }
+        }
+        size /= 2;
+    }
+
+    log_error("Data Record failed to allocate the buffer: Out of memory.");
+    return false;
+}
+
+void data_recorder_init(DataRecord *dr, uint16_t imu_sample_rate, uint8_t fallback_size_kb) {
+    dr->recording = false;
+    dr->autostart = true;
+    dr->autostop = true;
+    dr->decimation_counter = 0;
+    dr->last_time = 0;
+    dr->trigger_mask = DR_TRIGGER_NONE;
+    dr->trigger_reason = DR_TRIGGER_NONE;
+    dr->decimation_mode = DR_DECIMATION_SKIP;
+    dr->buffer_allocated = false;
+    dr->sampling = false;
+    dr->in_sample = false;
+
+    if (!find_firmware_buffer(dr) &&
+        (fallback_size_kb == 0 || !allocate_fallback_buffer(dr, fallback_size_kb))) {
         dr->enabled = false;
         return;
     }
 
     dr->enabled = true;
-    size_t size = buffer_info->length;
-    dr->sample_count = size / sizeof(Sample);
-    uint8_t *buffer = buffer_info->buffer;
-    circular_buffer_init(&dr->buffer, sizeof(Sample), dr->sample_count, buffer);
 
+    uint32_t mask = 0;
+    for (uint8_t i = 0; i < DATA_RECORD_CHANNELS_MAX; ++i) {
+        mask |= (uint32_t) item_recorded_by_default[i] << i;
+    }
     dr->sample_rate = imu_sample_rate;
+    set_channels(dr, mask, DR_DECIMATION_SKIP);
 
     // calculate decimation so that the recorded time period is at least 10 seconds
-    dr->decimation = max(10 * imu_sample_rate / dr->sample_count, 1);
+    dr->decimation = max(10 * imu_sample_rate / dr->sample_count, 1u);
+
+    dr->post_trigger_samples = dr->sample_count / 4;
+
+    log_msg(
+        "Data Record %s buffer size: %uB (%u samples)",
+        dr->buffer_allocated ? "package" : "firmware",
+        dr->buffer_size,
+        dr->sample_count
+    );
+}
 
-    log_msg("Data Record buffer size: %uB (%u samples)", size, dr->sample_count);
+void data_recorder_destroy(DataRecord *dr) {
+    dr->enabled = false;
+    if (dr->buffer_allocated) {
+        VESC_IF->free(dr->buffer_memory);
+        dr->buffer_memory = NULL;
+        dr->buffer_allocated = false;
+    }
 }
 
 void data_recorder_set_sample_rate(DataRecord *dr, uint16_t sample_rate) {
@@ -86,11 +228,25 @@ bool data_recorder_has_capability(const DataRecord *dr) {
     return dr->enabled;
 }
 
+bool data_recorder_is_fallback(const DataRecord *dr) {
+    return dr->enabled && dr->buffer_allocated;
+}
+
 void data_recorder_trigger(DataRecord *dr, bool engage) {
     if (!dr->enabled) {
         return;
     }
 
+    if (dr->trigger_mask != DR_TRIGGER_NONE) {
+        // In trigger mode the recording runs regardless of engagement. Only
+        // re-arm on engage if there's no triggered capture waiting to be fetched.
+        bool capture_pending = dr->trigger_reason != DR_TRIGGER_NONE && !dr->capture_fetched;
+        if (engage && !dr->recording && !capture_pending) {
+            start_recording(dr);
+        }
+        return;
+    }
+
     if (dr->autostart && engage) {
         start_recording(dr);
     } else if (dr->autostop && !engage) {
@@ -98,16 +254,76 @@ void data_recorder_trigger(DataRecord *dr, bool engage) {
     }
 }
 
-void data_recorder_sample(DataRecord *dr, const Data *d, time_t time) {
-    if (!dr->enabled || !dr->recording) {
+static void check_trigger(DataRecord *dr, const Data *d) {
+    uint8_t events = 0;
+    if (d->state.state == STATE_READY && d->state.stop_condition != STOP_NONE) {
+        events |= DR_TRIGGER_STOP;
+    }
+    if (alert_tracker_is_alert_active(&d->alert_tracker, ALERT_FW_FAULT)) {
+        events |= DR_TRIGGER_FW_FAULT;
+    }
+    if (d->state.wheelslip) {
+        events |= DR_TRIGGER_WHEELSLIP;
+    }
+    if (d->state.sat >= SAT_PB_SPEED) {
+        events |= DR_TRIGGER_PUSHBACK;
+    }
+
+    // only trigger on a rising edge of an event
+    uint8_t triggered = events & ~dr->trigger_events & dr->trigger_mask;
+    dr->trigger_events = events;
+    if (!triggered) {
         return;
     }
 
+    if (triggered & DR_TRIGGER_STOP) {
+        dr->trigger_reason = DR_TRIGGER_STOP;
+        dr->trigger_detail = d->state.stop_condition;
+    } else if (triggered & DR_TRIGGER_FW_FAULT) {
+        dr->trigger_reason = DR_TRIGGER_FW_FAULT;
+        dr->trigger_detail = d->alert_tracker.fw_fault_code;
+    } else if (triggered & DR_TRIGGER_WHEELSLIP) {
+        dr->trigger_reason = DR_TRIGGER_WHEELSLIP;
+        dr->trigger_detail = 0;
+    } else {
+        dr->trigger_reason = DR_TRIGGER_PUSHBACK;
+        dr->trigger_detail = d->state.sat;
+    }
+    dr->post_trigger_recorded = 0;
+}
+
+static void record_sample(DataRecord *dr, const Data *d, time_t time) {
+    // check on every call regardless of decimation to not miss short events
+    if (dr->trigger_mask != DR_TRIGGER_NONE && dr->trigger_reason == DR_TRIGGER_NONE) {
+        check_trigger(dr, d);
+    }
+
+    const uint8_t *data = (const uint8_t *) d;
+    if (dr->decimation_mode == DR_DECIMATION_ENVELOPE) {
+        for (uint8_t i = 0; i < dr->channel_count; ++i) {
+            float value = *(const float *) (data + dr->channel_offsets[i]);
+            if (dr->decimation_counter == 0 || value < dr->envelope_min[i]) {
+                dr->envelope_min[i] = value;
+            }
+            if (dr->decimation_counter == 0 || value > dr->envelope_max[i]) {
+                dr->envelope_max[i] = value;
+            }
+        }
+    }
+
     if (++dr->decimation_counter < dr->decimation) {
         return;
     }
     dr->decimation_counter = 0;
 
+    if (dr->trigger_reason != DR_TRIGGER_NONE) {
+        if (dr->post_trigger_recorded >= dr->post_trigger_samples) {
+            stop_recording(dr);
+            return;
+        }
+        ++dr->post_trigger_recorded;
+    }
+
     // keep timestamps strictly increasing: the 100us system tick can't
     // distinguish samples at high IMU rates (they arrive in bursts sharing a
     // tick), and duplicate timestamps break the download and plotting
@@ -119,25 +335,43 @@ void data_recorder_sample(DataRecord *dr, const Data *d, time_t time) {
     uint8_t flags = d->state.sat << 4 | d->footpad.state << 2;
     flags |= d->state.wheelslip << 1 | (d->state.state == STATE_RUNNING);
 
-    Sample sample =
-        {.time = time,
-         .flags = flags,
-         .values = {
-#define ARRAY_VALUE(target, id) to_float16(d->target),
-             VISIT_REC(RT_DATA_ALL_ITEMS, ARRAY_VALUE)
-#undef ARRAY_VALUE
-         }};
-    circular_buffer_push(&dr->buffer, &sample);
+    // gather the channels first to convert them all in one batch
+    float *values = dr->staging_values;
+    if (dr->decimation_mode == DR_DECIMATION_ENVELOPE) {
+        for (uint8_t i = 0; i < dr->channel_count; ++i) {
+            values[2 * i] = dr->envelope_min[i];
+            values[2 * i + 1] = dr->envelope_max[i];
+        }
+    } else {
+        for (uint8_t i = 0; i < dr->channel_count; ++i) {
+            values[i] = *(const float *) (data + dr->channel_offsets[i]);
+        }
+    }
+
+    Sample *sample = &dr->staging_sample;
+    sample->time = time;
+    sample->flags = flags;
+    to_float16_array(sample->values, values, value_count(dr));
+    seq_buffer_push(&dr->buffer, sample);
 }
 
-static void send_point_vt_experiment(const void *item, void *data) {
-    unused(data);
+void data_recorder_sample(DataRecord *dr, const Data *d, time_t time) {
+    if (!dr->enabled) {
+        return;
+    }
 
-    Sample *sample = (Sample *) item;
-    for (uint8_t i = 0; i < ITEMS_COUNT_REC(RT_DATA_ALL_ITEMS); ++i) {
-        VESC_IF->plot_set_graph(i);
-        VESC_IF->plot_send_points(sample->time, sample->values[i]);
+    // the handshake with set_channels(), see there
+    __atomic_store_n(&dr->in_sample, true, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&dr->sampling, __ATOMIC_SEQ_CST) && dr->recording) {
+        record_sample(dr, d, time);
     }
+    __atomic_store_n(&dr->in_sample, false, __ATOMIC_RELEASE);
+}
+
+// Returns the sequence number of the oldest sample of the current recording
+// still present in the buffer.
+static uint32_t oldest_seq(const DataRecord *dr, uint32_t head) {
+    return head - min(head - dr->start_seq, dr->sample_count);
 }
 
 void data_recorder_send_experiment_plot(DataRecord *dr) {
@@ -147,54 +381,150 @@ void data_recorder_send_experiment_plot(DataRecord *dr) {
 
     VESC_IF->plot_init("t", "v");
 
-#define ADD_GRAPH(target, id) VESC_IF->plot_add_graph(id);
-    VISIT_REC(RT_DATA_ALL_ITEMS, ADD_GRAPH);
-#undef ADD_GRAPH
+    // in envelope mode, there's a min and a max graph for each channel
+    const uint8_t values_per_channel = value_count(dr) / dr->channel_count;
+    for (uint8_t i = 0; i < DATA_RECORD_CHANNELS_MAX; ++i) {
+        if (dr->channel_mask & (1u << i)) {
+            for (uint8_t j = 0; j < values_per_channel; ++j) {
+                VESC_IF->plot_add_graph(item_ids[i]);
+            }
+        }
+    }
+
+    uint32_t head = seq_buffer_head(&dr->buffer);
+    Sample sample;
+    for (uint32_t seq = oldest_seq(dr, head); seq != head; ++seq) {
+        if (!seq_buffer_read(&dr->buffer, seq, &sample)) {
+            continue;
+        }
 
-    circular_buffer_iterate(&dr->buffer, &send_point_vt_experiment, 0);
+        for (uint8_t i = 0; i < value_count(dr); ++i) {
+            VESC_IF->plot_set_graph(i);
+            VESC_IF->plot_send_points(sample.time, sample.values[i]);
+        }
+    }
 }
 
 typedef enum {
     COMMAND_DATA_RECORD = 41,
     COMMAND_DATA_RECORD_HEADER = 42,
     COMMAND_DATA_RECORD_DATA = 43,
+    COMMAND_DATA_RECORD_STREAM = 44,
+    COMMAND_DATA_RECORD_BULK = 45,
 } DataRecordCommands;
 
 static void send_status(const DataRecord *dr) {
-    uint8_t buf[7];
+    uint8_t buf[16];
     int32_t ind = 0;
 
     buf[ind++] = 101;  // Package ID
     buf[ind++] = COMMAND_DATA_RECORD;
     buf[ind++] = dr->enabled;
-    buf[ind++] = dr->autostop << 2 | dr->autostart << 1 | dr->recording;
+    buf[ind++] = (dr->decimation_mode == DR_DECIMATION_ENVELOPE) << 4 |
+        (dr->trigger_reason != DR_TRIGGER_NONE) << 3 | dr->autostop << 2 | dr->autostart << 1 |
+        dr->recording;
     buf[ind++] = dr->decimation;
     uint32_t centiseconds = (uint32_t) dr->sample_count * 100 / dr->sample_rate;
     buffer_append_uint16(buf, min(centiseconds, 65535u), &ind);
+    buffer_append_uint32(buf, dr->channel_mask, &ind);
+    buf[ind++] = dr->trigger_mask;
+    buffer_append_uint32(buf, dr->post_trigger_samples, &ind);
 
-    SEND_APP_DATA(buf, 7, ind);
+    SEND_APP_DATA(buf, 16, ind);
 }
 
 static void send_header(DataRecord *dr) {
-    static const int bufsize = 256;
+    static const int bufsize = 2 + 4 + 1 + ITEMS_IDS_SIZE(RT_DATA_ALL_ITEMS) + 4 + 6 + 4 + 1;
     uint8_t buf[bufsize];
     int32_t ind = 0;
 
     buf[ind++] = 101;  // Package ID
     buf[ind++] = COMMAND_DATA_RECORD_HEADER;
 
-    buffer_append_uint32(buf, circular_buffer_size(&dr->buffer), &ind);
+    uint32_t head = seq_buffer_head(&dr->buffer);
+    dr->header_seq = oldest_seq(dr, head);
+    dr->header_size = head - dr->header_seq;
+    uint32_t size = dr->header_size;
+    buffer_append_uint32(buf, size, &ind);
 
-    buf[ind++] = ITEMS_COUNT_REC(RT_DATA_ALL_ITEMS);
-#define ADD_ID(target, id) buffer_append_string(buf, id, &ind);
-    VISIT_REC(RT_DATA_ALL_ITEMS, ADD_ID);
-#undef ADD_ID
+    buf[ind++] = dr->channel_count;
+    for (uint8_t i = 0; i < DATA_RECORD_CHANNELS_MAX; ++i) {
+        if (dr->channel_mask & (1u << i)) {
+            buffer_append_string(buf, item_ids[i], &ind);
+        }
+    }
+
+    buffer_append_uint32(buf, dr->channel_mask, &ind);
+
+    // index of the first sample recorded after the trigger event
+    uint32_t trigger_index = 0;
+    if (dr->trigger_reason != DR_TRIGGER_NONE && dr->post_trigger_recorded <= size) {
+        trigger_index = size - dr->post_trigger_recorded;
+    }
+    buf[ind++] = dr->trigger_reason;
+    buf[ind++] = dr->trigger_detail;
+    buffer_append_uint32(buf, trigger_index, &ind);
+
+    buffer_append_uint32(buf, dr->header_seq, &ind);
+
+    buf[ind++] = dr->decimation_mode;
+
+    dr->capture_fetched = true;
 
     SEND_APP_DATA(buf, bufsize, ind);
 }
 
-static void send_data(const DataRecord *dr, size_t offset) {
-    if (!dr->enabled || circular_buffer_size(&dr->buffer) == 0) {
+// On the wire, a sample is 4 bytes for time, 1 byte for flags and 2 bytes for
+// each value
+static size_t sample_wire_size(const DataRecord *dr) {
+    return 4 + 1 + 2 * value_count(dr);
+}
+
+// Appends up to count samples starting at seq, serialized directly from the
+// buffer memory. Returns the number of samples appended, 0 if the samples are
+// not available or have been overwritten while being serialized.
+static uint32_t append_samples(
+    const DataRecord *dr, uint8_t *buf, int32_t *ind, uint32_t seq, uint32_t count
+) {
+    const int32_t start_ind = *ind;
+    const size_t size = sample_size(dr);
+    const uint8_t values_count = value_count(dr);
+
+    uint32_t appended = 0;
+    while (appended < count) {
+        const void *span;
+        size_t n = seq_buffer_span(&dr->buffer, seq + appended, count - appended, &span);
+        if (n == 0) {
+            break;
+        }
+
+        const uint8_t *item = span;
+        for (size_t i = 0; i < n; ++i, item += size) {
+            // the items are packed back to back, time may be unaligned
+            time_t time;
+            memcpy(&time, item + offsetof(Sample, time), sizeof(time));
+            buffer_append_uint32(buf, time, ind);
+            buf[(*ind)++] = item[offsetof(Sample, flags)];
+
+            const uint16_t *values = (const uint16_t *) (item + offsetof(Sample, values));
+            for (uint8_t j = 0; j < values_count; ++j) {
+                buffer_append_uint16(buf, values[j], ind);
+            }
+        }
+        appended += n;
+    }
+
+    // the first sample is the oldest, if it's intact, all of them are
+    if (appended > 0 && !seq_buffer_is_readable(&dr->buffer, seq)) {
+        *ind = start_ind;
+        return 0;
+    }
+
+    return appended;
+}
+
+static void send_data(const DataRecord *dr, uint32_t offset) {
+    if (!dr->enabled || offset >= dr->header_size) {
         return;
     }
 
@@ -207,24 +537,112 @@ static void send_data(const DataRecord *dr, size_t offset) {
 
     buffer_append_uint32(buf, offset, &ind);
 
-    Sample sample;
-    while (circular_buffer_get(&dr->buffer, offset++, &sample)) {
-        buffer_append_uint32(buf, sample.time, &ind);
-        buf[ind++] = sample.flags;
+    uint32_t count = min((bufsize - ind) / sample_wire_size(dr), dr->header_size - offset);
+    append_samples(dr, buf, &ind, dr->header_seq + offset, count);
 
-        for (size_t i = 0; i < ITEMS_COUNT_REC(RT_DATA_ALL_ITEMS); ++i) {
-            buffer_append_uint16(buf, sample.values[i], &ind);
-        }
+    SEND_APP_DATA(buf, bufsize, ind);
+}
 
-        // 4 bytes for time, 1 byte for flags, 2 bytes for rest of the values
-        if (ind + 4 + 1 + 2 * ITEMS_COUNT_REC(RT_DATA_ALL_ITEMS) > bufsize) {
-            break;
+static void send_stream(const DataRecord *dr, uint32_t seq) {
+    static const int bufsize = SEND_BUF_MAX_SIZE;
+    uint8_t buf[bufsize];
+    int32_t ind = 0;
+
+    buf[ind++] = 101;  // Package ID
+    buf[ind++] = COMMAND_DATA_RECORD_STREAM;
+
+    uint32_t head = seq_buffer_head(&dr->buffer);
+    uint32_t oldest = oldest_seq(dr, head);
+    uint32_t lost = 0;
+    if (seq - oldest > head - oldest) {
+        if ((int32_t) (seq - head) > 0) {
+            // the cursor is ahead of the head (e.g. the buffer has been reset)
+            seq = head;
+        } else {
+            // overrun, the samples at the cursor have already been overwritten
+            lost = oldest - seq;
+            seq = oldest;
         }
     }
 
+    buffer_append_uint32(buf, seq, &ind);
+    buffer_append_uint32(buf, lost, &ind);
+    buffer_append_uint32(buf, head, &ind);
+
+    append_samples(dr, buf, &ind, seq, (bufsize - ind) / sample_wire_size(dr));
+
+    SEND_APP_DATA(buf, bufsize, ind);
+}
+
+// 2B command header, 2B packet number, 4B offset
+#define BULK_PACKET_HEADER_SIZE 8
+#define BULK_WINDOW_MAX 16
+
+static void send_bulk_packet(const DataRecord *dr, uint16_t packet) {
+    static const int bufsize = SEND_BUF_MAX_SIZE;
+    uint8_t buf[bufsize];
+    int32_t ind = 0;
+
+    buf[ind++] = 101;  // Package ID
+    buf[ind++] = COMMAND_DATA_RECORD_BULK;
+
+    const DataRecordBulk *bulk = &dr->bulk;
+    uint32_t offset = bulk->offset + (uint32_t) packet * bulk->samples_per_packet;
+    uint32_t count = min((uint32_t) bulk->samples_per_packet, bulk->offset + bulk->count - offset);
+
+    buffer_append_uint16(buf, packet, &ind);
+    buffer_append_uint32(buf, offset, &ind);
+
+    // in case the samples have been overwritten, the packet is sent empty
+    append_samples(dr, buf, &ind, dr->header_seq + offset, count);
+
     SEND_APP_DATA(buf, bufsize, ind);
 }
 
+static void send_bulk_window(DataRecord *dr) {
+    DataRecordBulk *bulk = &dr->bulk;
+    while (bulk->next_packet < bulk->packets &&
+           bulk->next_packet < bulk->acked_packets + bulk->window) {
+        send_bulk_packet(dr, bulk->next_packet++);
+    }
+}
+
+static void bulk_start(DataRecord *dr, uint32_t offset, uint32_t count, uint8_t window) {
+    DataRecordBulk *bulk = &dr->bulk;
+
+    offset = min(offset, dr->header_size);
+    bulk->offset = offset;
+    bulk->count = min(count, dr->header_size - offset);
+    bulk->samples_per_packet =
+        min((SEND_BUF_MAX_SIZE - BULK_PACKET_HEADER_SIZE) / sample_wire_size(dr), 255u);
+    bulk->count = min(bulk->count, (uint32_t) UINT16_MAX * bulk->samples_per_packet);
+    bulk->packets = (bulk->count + bulk->samples_per_packet - 1) / bulk->samples_per_packet;
+    bulk->next_packet = 0;
+    bulk->acked_packets = 0;
+    bulk->window = min(max(window, (uint8_t) 1), (uint8_t) BULK_WINDOW_MAX);
+
+    send_bulk_window(dr);
+}
+
+static void bulk_ack(DataRecord *dr, uint16_t acked_packets, const uint8_t *buffer, size_t len) {
+    DataRecordBulk *bulk = &dr->bulk;
+
+    // selective retransmission of the listed packets
+    int32_t ind = 0;
+    while (ind + 2 <= (int32_t) len) {
+        uint16_t packet = buffer_get_uint16(buffer, &ind);
+        if (packet < bulk->next_packet) {
+            send_bulk_packet(dr, packet);
+        }
+    }
+
+    if (acked_packets > bulk->acked_packets && acked_packets <= bulk->next_packet) {
+        bulk->acked_packets = acked_packets;
+    }
+
+    send_bulk_window(dr);
+}
+
 void data_recorder_request(DataRecord *dr, uint8_t *buffer, size_t len) {
     if (!dr->enabled) {
         log_error("Data Record not supported.");
@@ -240,7 +658,22 @@ void data_recorder_request(DataRecord *dr, uint8_t *buffer, size_t len) {
     uint8_t mode = buffer[ind++];
     uint8_t sub_mode = buffer[ind++];
     if (mode == 1) {  // control
-        if (sub_mode > 0) {
+        if (sub_mode == 5) {  // set recorded channels (clears the buffer)
+            if (len < 6) {
+                log_error("Data Record request missing channel mask, length: %u", len);
+                return;
+            }
+            if (!set_channels(dr, buffer_get_uint32(buffer, &ind), dr->decimation_mode)) {
+                log_error("Data Record channel mask selects no channels.");
+            }
+        } else if (sub_mode == 7) {  // set the number of post-trigger samples
+            if (len < 6) {
+                log_error("Data Record request missing sample count, length: %u", len);
+                return;
+            }
+            uint32_t samples = buffer_get_uint32(buffer, &ind);
+            dr->post_trigger_samples = min(samples, dr->sample_count);
+        } else if (sub_mode > 0) {
             if (len < 3) {
                 log_error("Data Record request missing value, length: %u", len);
                 return;
@@ -258,15 +691,28 @@ void data_recorder_request(DataRecord *dr, uint8_t *buffer, size_t len) {
                 dr->autostop = value;
             } else if (sub_mode == 4) {  // set decimation (record every Nth sample)
                 dr->decimation = value > 0 ? value : 1;
+            } else if (sub_mode == 6) {  // set trigger mode events
+                dr->trigger_mask = value;
+                if (dr->trigger_mask != DR_TRIGGER_NONE) {
+                    // arm the trigger right away
+                    start_recording(dr);
+                }
+            } else if (sub_mode == 8) {  // set decimation mode (clears the buffer)
+                if (value == DR_DECIMATION_SKIP || value == DR_DECIMATION_ENVELOPE) {
+                    set_channels(dr, dr->channel_mask, value);
+                }
             }
         }
         // sub_mode 0 is a no-op, just return the status
         send_status(dr);
     } else if (mode == 2) {  // send
         if (sub_mode == 1) {  // header
-            // pause recording; in theory a race, but the delay between sending the header
-            // and getting a data request should be enough for any writing to end
-            stop_recording(dr);
+            uint8_t flags = len >= 3 ? buffer[ind++] : 0;
+            // pause recording unless asked to keep recording (reading while
+            // recording is safe, but the oldest data get overwritten)
+            if (!(flags & 0x1)) {
+                stop_recording(dr);
+            }
             send_header(dr);
         } else if (sub_mode == 2) {  // data
             if (len < 6) {
@@ -274,8 +720,34 @@ void data_recorder_request(DataRecord *dr, uint8_t *buffer, size_t len) {
                 return;
             }
 
-            size_t offset = buffer_get_uint32(buffer, &ind);
+            uint32_t offset = buffer_get_uint32(buffer, &ind);
             send_data(dr, offset);
+        } else if (sub_mode == 3) {  // stream
+            if (len < 6) {
+                log_error("Data Record request missing sequence number, length: %u", len);
+                return;
+            }
+
+            uint32_t seq = buffer_get_uint32(buffer, &ind);
+            send_stream(dr, seq);
+        } else if (sub_mode == 4) {  // bulk transfer start
+            if (len < 11) {
+                log_error("Data Record bulk request missing data, length: %u", len);
+                return;
+            }
+
+            uint32_t offset = buffer_get_uint32(buffer, &ind);
+            uint32_t count = buffer_get_uint32(buffer, &ind);
+            uint8_t window = buffer[ind++];
+            bulk_start(dr, offset, count, window);
+        } else if (sub_mode == 5) {  // bulk transfer ack
+            if (len < 4) {
+                log_error("Data Record bulk ack missing data, length: %u", len);
+                return;
+            }
+
+            uint16_t acked_packets = buffer_get_uint16(buffer, &ind);
+            bulk_ack(dr, acked_packets, &buffer[ind], len - ind);
         }
     }
 }
@@ -27,14 +27,21 @@
 // firmware which reserves the buffer in memory and exposes the information
 // about it at the end of the VESC_IF memory area.
 //
+// On stock firmware, a smaller buffer of up to fallback_size_kb is allocated
+// from the package memory instead (0 disables the fallback).
+//
 // See: /doc/realtime_value_tracking.md
 
-void data_recorder_init(DataRecord *dr, uint16_t imu_sample_rate);
+void data_recorder_init(DataRecord *dr, uint16_t imu_sample_rate, uint8_t fallback_size_kb);
+
+void data_recorder_destroy(DataRecord *dr);
 
 void data_recorder_set_sample_rate(DataRecord *dr, uint16_t sample_rate);
 
 bool data_recorder_has_capability(const DataRecord *dr);
 
+bool data_recorder_is_fallback(const DataRecord *dr);
+
 void data_recorder_trigger(DataRecord *dr, bool engage);
 
 void data_recorder_sample(DataRecord *dr, const Data *data, time_t time);
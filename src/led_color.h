@@ -0,0 +1,43 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "lib/utils.h"
+
+#include <stdint.h>
+
+// The color math is done in fixed point, with factors in 1/256 units
+#define Q8_ONE 256
+
+static inline uint16_t to_q8(float x) {
+    return clampf(x, 0.0f, 1.0f) * Q8_ONE + 0.5f;
+}
+
+// Returns color1 * k1 + color2 * k2 (rounded) for each channel, k1 + k2 must
+// not exceed Q8_ONE. Works on two channels at a time, each in a 16 bit lane.
+static inline uint32_t color_mix(uint32_t color1, uint16_t k1, uint32_t color2, uint16_t k2) {
+    const uint32_t mask = 0x00FF00FF;
+    const uint32_t round = 0x00800080;
+    uint32_t rb = ((color1 & mask) * k1 + (color2 & mask) * k2 + round) >> 8;
+    uint32_t wg = ((color1 >> 8) & mask) * k1 + ((color2 >> 8) & mask) * k2 + round;
+    return (wg & ~mask) | (rb & mask);
+}
+
+static inline uint32_t color_blend(uint32_t color1, uint32_t color2, uint16_t blend) {
+    return color_mix(color1, Q8_ONE - blend, color2, blend);
+}
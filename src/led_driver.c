@@ -29,6 +29,21 @@
 #define WS2812_ZERO (((uint32_t) TIM_PERIOD) * 0.3)
 #define WS2812_ONE (((uint32_t) TIM_PERIOD) * 0.7)
 
+// The LEDs are streamed through a small circular DMA buffer: while the DMA
+// sends one half, the other one is encoded. A half is a multiple of 8 bits (a
+// color channel) and takes 480us to send, which is the deadline for encoding
+// the next half.
+#define HALF_BUFFER_BITS 384
+#define BUFFER_BITS (2 * HALF_BUFFER_BITS)
+
+// How long to wait for the DMA to free a half before giving up
+#define HALF_TIMEOUT_US 2000
+#define POLL_PERIOD_US 100
+
+// Iterations to wait for a DMA stream to disable, it only finishes the ongoing
+// transfer of one bit, which takes a fraction of that
+#define DMA_DISABLE_SPINS 10000
+
 static const PinHwConfig pin_hw_configs[] = {
     {
         .pin_port = GPIOB,
@@ -108,6 +123,12 @@ static void enable_dma_stream(const PinHwConfig *pin_hw_cfg) {
     pin_hw_cfg->dma_stream->CR |= DMA_SxCR_EN;
 }
 
+static void clear_dma_stream_flags(const PinHwConfig *pin_hw_cfg) {
+    const uint32_t dma_stream0_it_mask =
+        DMA_LISR_FEIF0 | DMA_LISR_DMEIF0 | DMA_LISR_TEIF0 | DMA_LISR_HTIF0 | DMA_LISR_TCIF0;
+    DMA1->LIFCR = dma_stream0_it_mask << pin_hw_cfg->dma_if_shift;
+}
+
 static void init_dma_stream(const PinHwConfig *pin_hw_cfg, uint16_t *buf, uint32_t buf_len) {
     // enable the AHB1 peripheral clock for DMA1
     // see: RCC_AHB1PeriphClockCmd()
@@ -118,25 +139,18 @@ static void init_dma_stream(const PinHwConfig *pin_hw_cfg, uint16_t *buf, uint32
 
     pin_hw_cfg->dma_stream->M1AR = 0;
 
-    const uint32_t dma_stream0_it_mask =
-        DMA_LISR_FEIF0 | DMA_LISR_DMEIF0 | DMA_LISR_TEIF0 | DMA_LISR_HTIF0 | DMA_LISR_TCIF0;
-    DMA1->LIFCR = dma_stream0_it_mask << pin_hw_cfg->dma_if_shift;
+    clear_dma_stream_flags(pin_hw_cfg);
 
     pin_hw_cfg->dma_stream->CR = pin_hw_cfg->dma_channel | DMA_DIR_MemoryToPeripheral |
         DMA_MemoryInc_Enable | DMA_PeripheralDataSize_HalfWord | DMA_MemoryDataSize_HalfWord |
-        DMA_Mode_Normal | DMA_Priority_High | DMA_MemoryBurst_Single | DMA_PeripheralBurst_Single;
+        DMA_Mode_Circular | DMA_Priority_High | DMA_MemoryBurst_Single |
+        DMA_PeripheralBurst_Single;
 
     pin_hw_cfg->dma_stream->FCR = 0x00000020 | DMA_FIFOThreshold_Full;
 
     pin_hw_cfg->dma_stream->M0AR = (uint32_t) buf;
     pin_hw_cfg->dma_stream->NDTR = buf_len;
     pin_hw_cfg->dma_stream->PAR = pin_hw_cfg->ccr_address;
-
-    enable_dma_stream(pin_hw_cfg);
-}
-
-static void reset_dma_stream_transfer_complete(const PinHwConfig *pin_hw_cfg) {
-    DMA1->LIFCR |= DMA_LIFCR_CTCIF0 << pin_hw_cfg->dma_if_shift;
 }
 
 static void disable_timer_dma(const PinHwConfig *pin_hw_cfg) {
@@ -155,10 +169,10 @@ static void init_hw(
                                                        : PAL_STM32_OTYPE_PUSHPULL;
     VESC_IF->set_pad_mode(cfg->pin_port, cfg->pin_nr, pin_mode);
 
-    reset_timer(cfg);
+    // the timer is reset beforehand, as it can be shared by more pins
+    // the stream is started by each frame
     init_dma_stream(cfg, buffer, length);
     init_timer(cfg);
-    enable_timer_dma(cfg);
 }
 
 static void deinit_hw(const PinHwConfig *cfg) {
@@ -166,158 +180,414 @@ static void deinit_hw(const PinHwConfig *cfg) {
     disable_dma_stream(cfg);
 }
 
-inline static uint8_t color_order_bits(LedColorOrder order) {
+// Gamma correction, (c * c + c) / 256
+// clang-format off
+static const uint8_t gamma_table[256] = {
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   3,   3,   3,   3,
+      4,   4,   4,   4,   5,   5,   5,   6,   6,   6,   7,   7,   7,   8,   8,   8,
+      9,   9,   9,  10,  10,  11,  11,  12,  12,  12,  13,  13,  14,  14,  15,  15,
+     16,  16,  17,  17,  18,  18,  19,  19,  20,  21,  21,  22,  22,  23,  24,  24,
+     25,  25,  26,  27,  27,  28,  29,  29,  30,  31,  31,  32,  33,  34,  34,  35,
+     36,  37,  37,  38,  39,  40,  41,  41,  42,  43,  44,  45,  45,  46,  47,  48,
+     49,  50,  51,  52,  53,  53,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,
+     64,  65,  66,  67,  68,  69,  70,  71,  72,  73,  74,  76,  77,  78,  79,  80,
+     81,  82,  83,  84,  86,  87,  88,  89,  90,  92,  93,  94,  95,  96,  98,  99,
+    100, 101, 103, 104, 105, 106, 108, 109, 110, 112, 113, 114, 116, 117, 118, 120,
+    121, 123, 124, 125, 127, 128, 130, 131, 132, 134, 135, 137, 138, 140, 141, 143,
+    144, 146, 147, 149, 150, 152, 153, 155, 157, 158, 160, 161, 163, 164, 166, 168,
+    169, 171, 173, 174, 176, 178, 179, 181, 183, 184, 186, 188, 189, 191, 193, 195,
+    196, 198, 200, 202, 203, 205, 207, 209, 211, 212, 214, 216, 218, 220, 222, 224,
+    225, 227, 229, 231, 233, 235, 237, 239, 241, 243, 245, 247, 249, 251, 253, 255,
+};
+// clang-format on
+
+#define NIBBLE_BIT(n, bit) (((n) >> (bit)) & 0x1 ? WS2812_ONE : WS2812_ZERO)
+#define NIBBLE_PULSES(n) {NIBBLE_BIT(n, 3), NIBBLE_BIT(n, 2), NIBBLE_BIT(n, 1), NIBBLE_BIT(n, 0)}
+
+// Timer values of the 4 bits of a nibble, MSB first. A table for whole bytes
+// would be faster still, but it would take 4kB.
+static const uint16_t nibble_pulses[16][4] = {
+    NIBBLE_PULSES(0x0),
+    NIBBLE_PULSES(0x1),
+    NIBBLE_PULSES(0x2),
+    NIBBLE_PULSES(0x3),
+    NIBBLE_PULSES(0x4),
+    NIBBLE_PULSES(0x5),
+    NIBBLE_PULSES(0x6),
+    NIBBLE_PULSES(0x7),
+    NIBBLE_PULSES(0x8),
+    NIBBLE_PULSES(0x9),
+    NIBBLE_PULSES(0xA),
+    NIBBLE_PULSES(0xB),
+    NIBBLE_PULSES(0xC),
+    NIBBLE_PULSES(0xD),
+    NIBBLE_PULSES(0xE),
+    NIBBLE_PULSES(0xF),
+};
+
+// Shifts of the color channels in the order they're sent, for a color stored
+// as WRGB (see RGBW() in leds.c)
+static void set_channel_shifts(StripEncoding *enc, LedColorOrder order) {
     switch (order) {
-    case LED_COLOR_GRBW:
-    case LED_COLOR_WRGB:
-        return 32;
     case LED_COLOR_GRB:
+        *enc = (StripEncoding) {.channels = 3, .shifts = {8, 16, 0}};
+        return;
+    case LED_COLOR_GRBW:
+        *enc = (StripEncoding) {.channels = 4, .shifts = {8, 16, 0, 24}};
+        return;
     case LED_COLOR_RGB:
-        return 24;
+        *enc = (StripEncoding) {.channels = 3, .shifts = {16, 8, 0}};
+        return;
+    case LED_COLOR_WRGB:
+        *enc = (StripEncoding) {.channels = 4, .shifts = {24, 16, 8, 0}};
+        return;
     }
+}
+
+// Returns false if the DMA stream didn't disable to start the frame.
+static bool start_frame(const PinHwConfig *cfg, uint16_t *buffer) {
+    disable_timer_dma(cfg);
+    disable_dma_stream(cfg);
+    // the stream is only disabled after the ongoing transfer finishes
+    for (uint32_t i = 0; cfg->dma_stream->CR & DMA_SxCR_EN; ++i) {
+        if (i == DMA_DISABLE_SPINS) {
+            return false;
+        }
+    }
+
+    clear_dma_stream_flags(cfg);
+    cfg->dma_stream->M0AR = (uint32_t) buffer;
+    cfg->dma_stream->NDTR = BUFFER_BITS;
+    enable_dma_stream(cfg);
+    enable_timer_dma(cfg);
+    return true;
+}
 
-    // the switch above should be exhaustive, just silence the warning
-    return 24;
+static void stop_frame(const PinHwConfig *cfg) {
+    disable_timer_dma(cfg);
+    disable_dma_stream(cfg);
 }
 
-void led_driver_init(LedDriver *driver) {
-    driver->bitbuffer_length = 0;
-    driver->bitbuffer = NULL;
+// Encoding state of a frame sent on one output
+typedef struct {
+    const LedOutput *output;
+    uint8_t strip;  // index into output->strips
+    uint16_t led;
+    uint8_t channel;
+    uint8_t next_half;
+    uint8_t end_halves;  // number of halves filled since the end of the data
+    bool failed;
+    bool done;
+} Stream;
+
+// Fills the next half of the buffer with the following LED channels, and with
+// zeros (the output is held low) after the end of the data.
+static void fill_half(const LedDriver *driver, Stream *s) {
+    const LedOutput *out = s->output;
+    uint16_t *buf = out->buffer + s->next_half * HALF_BUFFER_BITS;
+    uint16_t *end = buf + HALF_BUFFER_BITS;
+
+    while (buf < end && s->strip < out->strip_count) {
+        uint8_t strip_i = out->strips[s->strip];
+        const StripEncoding *enc = &driver->strip_encodings[strip_i];
+        uint32_t color = driver->strip_colors[strip_i][s->led];
+
+        uint8_t c = gamma_table[(color >> enc->shifts[s->channel]) & 0xFF];
+        memcpy(buf, nibble_pulses[c >> 4], sizeof(nibble_pulses[0]));
+        memcpy(buf + 4, nibble_pulses[c & 0xF], sizeof(nibble_pulses[0]));
+        buf += 8;
+
+        if (++s->channel == enc->channels) {
+            s->channel = 0;
+            if (++s->led == driver->strips[strip_i]->length) {
+                s->led = 0;
+                ++s->strip;
+            }
+        }
+    }
+
+    if (s->strip == out->strip_count) {
+        memset(buf, 0, sizeof(uint16_t) * (end - buf));
+        ++s->end_halves;
+    }
+
+    s->next_half ^= 1;
 }
 
-bool led_driver_setup(
-    LedDriver *driver, LedPin pin, LedPinConfig pin_config, const LedStrip **led_strips
-) {
-    if (pin > LED_PIN_LAST) {
-        log_error("Invalid LED pin configured: %u", pin);
+// Returns whether the DMA finished sending the half to be filled next. Marks
+// the stream failed if the DMA got past the other half as well, meaning it's
+// already sending stale data.
+static bool half_free(Stream *s) {
+    const uint8_t shift = s->output->hw_config->dma_if_shift;
+    const uint32_t flag = (s->next_half == 0 ? DMA_LISR_HTIF0 : DMA_LISR_TCIF0) << shift;
+    const uint32_t other_flag = (s->next_half == 0 ? DMA_LISR_TCIF0 : DMA_LISR_HTIF0) << shift;
+
+    uint32_t flags = DMA1->LISR;
+    if (!(flags & flag)) {
         return false;
     }
-    driver->pin_hw_config = &pin_hw_configs[pin];
 
+    DMA1->LIFCR = flag;
+    if (flags & other_flag) {
+        s->failed = true;
+    }
+    return true;
+}
+
+static void stop_outputs(const LedDriver *driver, const Stream *streams) {
+    for (uint8_t i = 0; i < driver->output_count; ++i) {
+        if (!streams[i].done) {
+            stop_frame(streams[i].output->hw_config);
+        }
+    }
+}
+
+// Sends the frame on all outputs at once. The frames end with a half of zeros
+// for the reset (latch) period. Returns false if any of the outputs failed.
+static bool send_frame(const LedDriver *driver) {
+    Stream streams[STRIP_COUNT];
+    for (uint8_t i = 0; i < driver->output_count; ++i) {
+        Stream *s = &streams[i];
+        *s = (Stream) {.output = &driver->outputs[i]};
+        fill_half(driver, s);
+        fill_half(driver, s);
+    }
+
+    for (uint8_t i = 0; i < driver->output_count; ++i) {
+        if (!start_frame(driver->outputs[i].hw_config, driver->outputs[i].buffer)) {
+            stop_outputs(driver, streams);
+            return false;
+        }
+    }
+
+    bool ok = true;
+    uint8_t running = driver->output_count;
+    uint32_t waited_us = 0;
+    while (running > 0) {
+        bool progress = false;
+        for (uint8_t i = 0; i < driver->output_count; ++i) {
+            Stream *s = &streams[i];
+            if (s->done || !half_free(s)) {
+                continue;
+            }
+
+            progress = true;
+            if (s->failed || s->end_halves >= 2) {
+                stop_frame(s->output->hw_config);
+                ok &= !s->failed;
+                s->done = true;
+                --running;
+            } else {
+                fill_half(driver, s);
+            }
+        }
+
+        if (progress) {
+            waited_us = 0;
+        } else if (waited_us >= HALF_TIMEOUT_US) {
+            // the DMA isn't progressing
+            stop_outputs(driver, streams);
+            return false;
+        } else {
+            VESC_IF->sleep_us(POLL_PERIOD_US);
+            waited_us += POLL_PERIOD_US;
+        }
+    }
+
+    return ok;
+}
+
+void led_driver_init(LedDriver *driver) {
     driver->bitbuffer_length = 0;
+    driver->bitbuffer = NULL;
+    driver->output_count = 0;
+    driver->colors = NULL;
+    driver->last_sent = 0.0f;
+    driver->resend = false;
+    driver->frame_duration = 0.0f;
+    memset(&driver->stats, 0, sizeof(LedDriverStats));
+}
 
-    size_t offsets[3] = {0};
-    for (size_t i = 0; i < STRIP_COUNT; ++i) {
+bool led_driver_setup(
+    LedDriver *driver, const LedPin *pins, LedPinConfig pin_config, const LedStrip **led_strips
+) {
+    driver->output_count = 0;
+    uint32_t led_count = 0;
+    for (uint8_t i = 0; i < STRIP_COUNT; ++i) {
         const LedStrip *strip = led_strips[i];
+        driver->strips[i] = strip;
         if (!strip) {
-            driver->strips[i] = NULL;
-            driver->strip_bitbuffs[i] = NULL;
             continue;
         }
 
-        driver->strips[i] = strip;
-        offsets[i] = driver->bitbuffer_length;
-        driver->bitbuffer_length += color_order_bits(strip->color_order) * strip->length;
+        if (pins[i] > LED_PIN_LAST) {
+            log_error("Invalid LED pin configured: %u", pins[i]);
+            return false;
+        }
+
+        set_channel_shifts(&driver->strip_encodings[i], strip->color_order);
+        led_count += strip->length;
+
+        // strips on the same pin are chained in their order
+        LedOutput *out = NULL;
+        for (uint8_t j = 0; j < driver->output_count; ++j) {
+            if (driver->outputs[j].pin == pins[i]) {
+                out = &driver->outputs[j];
+            }
+        }
+        if (!out) {
+            out = &driver->outputs[driver->output_count++];
+            out->pin = pins[i];
+            out->hw_config = &pin_hw_configs[pins[i]];
+            out->strip_count = 0;
+        }
+        out->strips[out->strip_count++] = i;
     }
 
-    // An extra array item to set the output to 0 PWM
-    ++driver->bitbuffer_length;
+    for (uint8_t i = 0; i < driver->output_count; ++i) {
+        const LedOutput *out = &driver->outputs[i];
+        uint32_t pin_leds = 0;
+        for (uint8_t j = 0; j < out->strip_count; ++j) {
+            pin_leds += driver->strips[out->strips[j]]->length;
+        }
+
+        if (pin_leds > LED_DRIVER_PIN_LEDS_MAX) {
+            log_error(
+                "Too many LEDs on pin %u: %u (max %u)", out->pin, pin_leds, LED_DRIVER_PIN_LEDS_MAX
+            );
+            driver->output_count = 0;
+            return false;
+        }
+    }
+
+    driver->bitbuffer_length = BUFFER_BITS * driver->output_count;
     driver->bitbuffer = VESC_IF->malloc(sizeof(uint16_t) * driver->bitbuffer_length);
-    driver->pin = pin;
 
     if (!driver->bitbuffer) {
         log_error("Failed to init LED driver, out of memory.");
         return false;
     }
 
-    for (size_t i = 0; i < STRIP_COUNT; ++i) {
+    driver->colors = VESC_IF->malloc(sizeof(uint32_t) * led_count);
+    if (!driver->colors) {
+        log_error("Failed to init LED driver, out of memory.");
+        VESC_IF->free(driver->bitbuffer);
+        driver->bitbuffer = NULL;
+        return false;
+    }
+    memset(driver->colors, 0, sizeof(uint32_t) * led_count);
+
+    uint32_t *colors = driver->colors;
+    for (uint8_t i = 0; i < STRIP_COUNT; ++i) {
         if (driver->strips[i]) {
-            driver->strip_bitbuffs[i] = driver->bitbuffer + offsets[i];
+            driver->strip_colors[i] = colors;
+            colors += driver->strips[i]->length;
         }
     }
 
-    for (uint32_t i = 0; i < driver->bitbuffer_length - 1; ++i) {
-        driver->bitbuffer[i] = WS2812_ZERO;
+    // send the first frame even if all LEDs are black
+    driver->resend = true;
+
+    for (uint8_t i = 0; i < driver->output_count; ++i) {
+        driver->outputs[i].buffer = driver->bitbuffer + i * BUFFER_BITS;
+        reset_timer(driver->outputs[i].hw_config);
     }
-    driver->bitbuffer[driver->bitbuffer_length - 1] = 0;
 
-    init_hw(driver->pin_hw_config, pin_config, driver->bitbuffer, driver->bitbuffer_length);
+    for (uint8_t i = 0; i < driver->output_count; ++i) {
+        const LedOutput *out = &driver->outputs[i];
+        init_hw(out->hw_config, pin_config, out->buffer, BUFFER_BITS);
+    }
     return true;
 }
 
-inline static uint8_t cgamma(uint8_t c) {
-    return (c * c + c) / 256;
-}
-
-static uint32_t color_grb(uint8_t w, uint8_t r, uint8_t g, uint8_t b) {
-    unused(w);
-    return (g << 16) | (r << 8) | b;
-}
-
-static uint32_t color_grbw(uint8_t w, uint8_t r, uint8_t g, uint8_t b) {
-    return (g << 24) | (r << 16) | (b << 8) | w;
-}
-
-static uint32_t color_rgb(uint8_t w, uint8_t r, uint8_t g, uint8_t b) {
-    unused(w);
-    return (r << 16) | (g << 8) | b;
-}
-
-static uint32_t color_wrgb(uint8_t w, uint8_t r, uint8_t g, uint8_t b) {
-    return (w << 24) | (r << 16) | (g << 8) | b;
-}
-
 void led_driver_paint(LedDriver *driver) {
     if (!driver->bitbuffer) {
         return;
     }
 
-    for (size_t i = 0; i < STRIP_COUNT; ++i) {
+    LedDriverStats *stats = &driver->stats;
+    if (stats->reset_requested) {
+        memset(stats, 0, sizeof(LedDriverStats));
+    }
+
+    uint32_t changed = 0;
+    uint32_t led_count = 0;
+    for (uint8_t i = 0; i < STRIP_COUNT; ++i) {
         const LedStrip *strip = driver->strips[i];
         if (!strip) {
-            break;
-        }
-
-        uint32_t (*color_conv)(uint8_t, uint8_t, uint8_t, uint8_t);
-        switch (strip->color_order) {
-        case LED_COLOR_GRB:
-            color_conv = color_grb;
-            break;
-        case LED_COLOR_GRBW:
-            color_conv = color_grbw;
-            break;
-        case LED_COLOR_RGB:
-            color_conv = color_rgb;
-            break;
-        case LED_COLOR_WRGB:
-            color_conv = color_wrgb;
-            break;
+            continue;
         }
 
-        uint8_t bits = color_order_bits(strip->color_order);
-        uint16_t *strip_bitbuffer = driver->strip_bitbuffs[i];
-
+        uint32_t *colors = driver->strip_colors[i];
         for (uint32_t j = 0; j < strip->length; ++j) {
             uint32_t color = strip->data[j];
-            uint8_t w = cgamma((color >> 24) & 0xFF);
-            uint8_t r = cgamma((color >> 16) & 0xFF);
-            uint8_t g = cgamma((color >> 8) & 0xFF);
-            uint8_t b = cgamma(color & 0xFF);
-
-            color = color_conv(w, r, g, b);
-
-            for (int8_t bit = bits - 1; bit >= 0; --bit) {
-                strip_bitbuffer[bit + j * bits] = color & 0x1 ? WS2812_ONE : WS2812_ZERO;
-                color >>= 1;
+            if (color != colors[j]) {
+                colors[j] = color;
+                ++changed;
             }
         }
+        led_count += strip->length;
     }
 
-    const PinHwConfig *cfg = driver->pin_hw_config;
-    disable_timer_dma(cfg);
-    disable_dma_stream(cfg);
-    reset_dma_stream_transfer_complete(cfg);
-    enable_dma_stream(cfg);
-    enable_timer_dma(cfg);
+    ++stats->frames;
+
+    // the LEDs hold the last frame, no need to send an unchanged one
+    float start = VESC_IF->system_time();
+    if (changed == 0 && !driver->resend &&
+        start - driver->last_sent < LED_DRIVER_REFRESH_PERIOD) {
+        ++stats->frames_skipped;
+        return;
+    }
+
+    if (VESC_IF->thread_set_priority) {
+        VESC_IF->thread_set_priority(LED_DRIVER_SEND_PRIORITY);
+    }
+    bool ok = send_frame(driver);
+    if (VESC_IF->thread_set_priority) {
+        VESC_IF->thread_set_priority(LED_DRIVER_THREAD_PRIORITY);
+    }
+    driver->last_sent = VESC_IF->system_time();
+    driver->frame_duration = driver->last_sent - start;
+
+    stats->leds_encoded += led_count;
+    // a glitched frame is sent again on the next paint
+    driver->resend = !ok;
+    if (!ok) {
+        ++stats->underruns;
+    }
 }
 
 void led_driver_destroy(LedDriver *driver) {
     if (driver->bitbuffer) {
         // only touch the timer/DMA if we inited it - something else could be using it
-        deinit_hw(driver->pin_hw_config);
+        for (uint8_t i = 0; i < driver->output_count; ++i) {
+            deinit_hw(driver->outputs[i].hw_config);
+        }
 
         VESC_IF->free(driver->bitbuffer);
         driver->bitbuffer = NULL;
     }
+    if (driver->colors) {
+        VESC_IF->free(driver->colors);
+        driver->colors = NULL;
+    }
     driver->bitbuffer_length = 0;
+    driver->output_count = 0;
+}
+
+float led_driver_frame_duration(const LedDriver *driver) {
+    return driver->frame_duration;
+}
+
+bool led_driver_resend_pending(const LedDriver *driver) {
+    return driver->resend;
+}
+
+const LedDriverStats *led_driver_get_stats(const LedDriver *driver) {
+    return &driver->stats;
+}
+
+void led_driver_reset_stats(LedDriver *driver) {
+    driver->stats.reset_requested = true;
 }
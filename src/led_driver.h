@@ -41,21 +41,91 @@ typedef struct {
     uint8_t pin_nr;
 } PinHwConfig;
 
+// Maximum number of LEDs chained on one pin. Sending a frame takes 30us per
+// LED (40us for RGBW), the aux thread is blocked for the time.
+#define LED_DRIVER_PIN_LEDS_MAX 1024
+
+// Priorities (relative to normal) of the aux thread which paints the LEDs. The
+// encoding of the next half of the DMA buffer has to keep up with the DMA, so
+// the thread is raised above the other threads while sending a frame. It
+// sleeps while waiting for the DMA, the CPU is only taken for the encoding.
+#define LED_DRIVER_THREAD_PRIORITY -1
+#define LED_DRIVER_SEND_PRIORITY 1
+
+// Frames are only sent when an LED changed, but at least once per this period
+// (in seconds), to recover LEDs from possible glitches on the data line
+#define LED_DRIVER_REFRESH_PERIOD 1.0f
+
+typedef struct {
+    bool reset_requested;
+    uint32_t frames;  // number of led_driver_paint() calls
+    uint32_t frames_skipped;  // frames not sent as no LED changed
+    uint32_t leds_encoded;  // number of LEDs encoded into the bitbuffer
+    uint32_t underruns;  // frames in which the encoding didn't keep up with the DMA
+} LedDriverStats;
+
+// Order of the color channels of a strip, resolved at setup
+typedef struct {
+    uint8_t channels;
+    uint8_t shifts[4];  // shifts of the channels in the color, in the order they're sent
+} StripEncoding;
+
+// A pin with a chain of strips connected to it, the outputs are sent in parallel
 typedef struct {
-    uint16_t *bitbuffer;
-    uint32_t bitbuffer_length;
     LedPin pin;
-    const PinHwConfig *pin_hw_config;
+    const PinHwConfig *hw_config;
+    uint16_t *buffer;
+    uint8_t strip_count;
+    uint8_t strips[STRIP_COUNT];  // indices into LedDriver.strips, in the chain order
+} LedOutput;
+
+typedef struct {
+    uint16_t *bitbuffer;  // the DMA buffers of all outputs
+    uint32_t bitbuffer_length;
+    LedOutput outputs[STRIP_COUNT];
+    uint8_t output_count;
     const LedStrip *strips[STRIP_COUNT];
-    uint16_t *strip_bitbuffs[STRIP_COUNT];
+    StripEncoding strip_encodings[STRIP_COUNT];
+    uint32_t *strip_colors[STRIP_COUNT];
+
+    // the colors of the last frame sent, to only send a frame on a change
+    uint32_t *colors;
+    float last_sent;  // system time of the last frame sent
+    bool resend;
+    // time it took to send the last frame, in seconds
+    float frame_duration;
+    LedDriverStats stats;
 } LedDriver;
 
 void led_driver_init(LedDriver *driver);
 
+/**
+ * Sets up the driver for the strips, each on the pin at the same index in
+ * `pins`. Strips on the same pin are chained in the order of `led_strips`.
+ */
 bool led_driver_setup(
-    LedDriver *driver, LedPin pin, LedPinConfig pin_config, const LedStrip **led_strips
+    LedDriver *driver, const LedPin *pins, LedPinConfig pin_config, const LedStrip **led_strips
 );
 
 void led_driver_paint(LedDriver *driver);
 
+/**
+ * Returns the time it took to send the last frame in seconds (0 before the
+ * first frame).
+ */
+float led_driver_frame_duration(const LedDriver *driver);
+
+/**
+ * Returns true if the last frame failed to send and the next paint sends it
+ * again, even if no LED changed.
+ */
+bool led_driver_resend_pending(const LedDriver *driver);
+
+const LedDriverStats *led_driver_get_stats(const LedDriver *driver);
+
+/**
+ * Requests a reset of the statistics, it's done on the next paint.
+ */
+void led_driver_reset_stats(LedDriver *driver);
+
 void led_driver_destroy(LedDriver *driver);
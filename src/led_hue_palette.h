@@ -0,0 +1,60 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+
+// Colors of all hues (0..255) for the rainbow animations and LED programs,
+// as 0x00RRGGBB. Generated by and tested against the hue_to_color() reference
+// in test/test_led_hue_palette.c.
+// clang-format off
+static const uint32_t hue_palette[256] = {
+    0xf700e2, 0xf800df, 0xf900dc, 0xfa00d8, 0xfb00d5, 0xfb00d1, 0xfc00cd, 0xfc00c8,
+    0xfd00c4, 0xfd00bf, 0xfd00ba, 0xfd00b5, 0xfe00af, 0xfe00aa, 0xfe00a4, 0xfe009e,
+    0xfe0097, 0xfe0091, 0xfe008a, 0xfe0083, 0xfe007c, 0xfe0074, 0xfe006d, 0xfe0065,
+    0xfe005e, 0xfe0057, 0xfe004f, 0xfe0048, 0xfe0041, 0xfe003a, 0xfe0033, 0xfe002c,
+    0xfe0026, 0xfe001f, 0xfe001a, 0xfe0014, 0xfe0010, 0xfe000b, 0xff0008, 0xff0004,
+    0xff0002, 0xff0000, 0xff0000, 0xff0000, 0xff0100, 0xff0300, 0xff0500, 0xff0900,
+    0xfe0d00, 0xfe1200, 0xfe1800, 0xfe1e00, 0xfe2400, 0xfe2b00, 0xfe3200, 0xfe3a00,
+    0xfe4100, 0xfe4900, 0xfe5100, 0xfe5900, 0xfe6100, 0xfe6900, 0xfe7100, 0xfe7900,
+    0xfe8000, 0xfe8800, 0xfe8f00, 0xfe9600, 0xfe9d00, 0xfea400, 0xfeaa00, 0xfeb000,
+    0xfeb600, 0xfebb00, 0xfdc000, 0xfdc500, 0xfdca00, 0xfdce00, 0xfcd200, 0xfcd600,
+    0xfbda00, 0xfbdd00, 0xfae000, 0xf9e300, 0xf8e600, 0xf7e800, 0xf6eb00, 0xf5ed00,
+    0xf3ef00, 0xf1f100, 0xeff200, 0xedf400, 0xebf500, 0xe9f600, 0xe6f700, 0xe3f800,
+    0xdff900, 0xdbfa00, 0xd7fb00, 0xd3fb00, 0xcefc00, 0xc9fc00, 0xc3fd00, 0xbefd00,
+    0xb7fd00, 0xb0fd00, 0xa9fe00, 0xa1fe00, 0x99fe00, 0x91fe00, 0x88fe00, 0x7efe00,
+    0x75fe00, 0x6bfe00, 0x61fe00, 0x57fe00, 0x4dfe00, 0x43fe00, 0x39fe00, 0x30fe00,
+    0x27fe00, 0x1efe00, 0x16fe00, 0x0ffe00, 0x09fe00, 0x05fe00, 0x01ff00, 0x00ff00,
+    0x00ff00, 0x00ff00, 0x00fe02, 0x00fe04, 0x00fe08, 0x00fe0b, 0x00fe10, 0x00fe14,
+    0x00fe1a, 0x00fe1f, 0x00fe26, 0x00fe2c, 0x00fe33, 0x00fe3a, 0x00fe41, 0x00fe48,
+    0x00fe4f, 0x00fe57, 0x00fe5e, 0x00fe65, 0x00fe6d, 0x00fe74, 0x00fd7c, 0x00fd83,
+    0x00fd8a, 0x00fd91, 0x00fc97, 0x00fc9e, 0x00fba4, 0x00fbaa, 0x00faaf, 0x00f9b5,
+    0x00f8ba, 0x00f7bf, 0x00f6c4, 0x00f5c8, 0x00f4cd, 0x00f2d1, 0x00f1d5, 0x00efd8,
+    0x00eddc, 0x00ebdf, 0x00e8e2, 0x00e6e4, 0x00e3e7, 0x00e0e9, 0x00ddec, 0x00daee,
+    0x00d6ef, 0x00d2f1, 0x00cef3, 0x00caf4, 0x00c5f5, 0x00c0f7, 0x00bbf8, 0x00b6f9,
+    0x00b0f9, 0x00aafa, 0x00a4fb, 0x009dfb, 0x0096fc, 0x008ffc, 0x0088fd, 0x0080fd,
+    0x0079fd, 0x0071fe, 0x0069fe, 0x0061fe, 0x0059fe, 0x0051fe, 0x0049fe, 0x0041fe,
+    0x003afe, 0x0032fe, 0x002bfe, 0x0024fe, 0x001efe, 0x0018fe, 0x0012fe, 0x000dfe,
+    0x0009fe, 0x0005fe, 0x0003fe, 0x0001fe, 0x0000ff, 0x0000ff, 0x0100fe, 0x0500fe,
+    0x0900fe, 0x0f00fe, 0x1600fe, 0x1e00fe, 0x2700fe, 0x3000fe, 0x3900fe, 0x4300fe,
+    0x4d00fe, 0x5700fe, 0x6100fe, 0x6b00fe, 0x7500fe, 0x7e00fe, 0x8800fe, 0x9100fe,
+    0x9900fe, 0xa100fd, 0xa900fd, 0xb000fd, 0xb700fc, 0xbe00fc, 0xc300fb, 0xc900fb,
+    0xce00fa, 0xd300f9, 0xd700f9, 0xdb00f8, 0xdf00f7, 0xe300f5, 0xe600f4, 0xe900f3,
+    0xeb00f1, 0xed00ef, 0xef00ee, 0xf100ec, 0xf300e9, 0xf500e7, 0xf600e4, 0xf700e2,
+};
+// clang-format on
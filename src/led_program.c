@@ -0,0 +1,457 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include "led_program.h"
+
+#include "led_color.h"
+#include "lib/utils.h"
+
+#include <string.h>
+
+#define LED_PROGRAM_WORDS (LED_PROGRAM_SIZE_MAX / 4)
+#define LED_PROGRAM_MAGIC 0x4C50u
+
+#define Q16_ONE 65536
+
+typedef struct {
+    uint8_t size;  // the opcode and its immediate operand, 0 for an invalid opcode
+    uint8_t pops;
+    uint8_t pushes;
+    bool dynamic;
+} OpInfo;
+
+static const OpInfo op_info[] = {
+    [LP_OP_CONST] = {3, 0, 1, false},
+    [LP_OP_TIME] = {1, 0, 1, true},
+    [LP_OP_INDEX] = {1, 0, 1, false},
+    [LP_OP_POS] = {1, 0, 1, false},
+    [LP_OP_LENGTH] = {1, 0, 1, false},
+    [LP_OP_SPEED] = {1, 0, 1, true},
+    [LP_OP_DUTY] = {1, 0, 1, true},
+    [LP_OP_PITCH] = {1, 0, 1, true},
+
+    [LP_OP_ADD] = {1, 2, 1, false},
+    [LP_OP_SUB] = {1, 2, 1, false},
+    [LP_OP_MUL] = {1, 2, 1, false},
+    [LP_OP_DIV] = {1, 2, 1, false},
+    [LP_OP_MIN] = {1, 2, 1, false},
+    [LP_OP_MAX] = {1, 2, 1, false},
+    [LP_OP_LT] = {1, 2, 1, false},
+    [LP_OP_SELECT] = {1, 3, 1, false},
+
+    [LP_OP_NEG] = {1, 1, 1, false},
+    [LP_OP_ABS] = {1, 1, 1, false},
+    [LP_OP_FRAC] = {1, 1, 1, false},
+    [LP_OP_SIN] = {1, 1, 1, false},
+    [LP_OP_SAT] = {1, 1, 1, false},
+
+    [LP_OP_DUP] = {1, 1, 2, false},
+    [LP_OP_SWAP] = {1, 2, 2, false},
+    [LP_OP_DROP] = {1, 1, 0, false},
+
+    [LP_OP_HUE] = {1, 1, 1, false},
+    [LP_OP_COLOR1] = {1, 0, 1, false},
+    [LP_OP_COLOR2] = {1, 0, 1, false},
+    [LP_OP_PALETTE] = {2, 0, 1, false},
+    [LP_OP_RGB] = {1, 3, 1, false},
+    [LP_OP_MIX] = {1, 3, 1, false},
+    [LP_OP_SCALE] = {1, 2, 1, false},
+};
+
+#define OP_COUNT (sizeof(op_info) / sizeof(op_info[0]))
+
+// Checks the program can't access anything out of bounds when it runs: all
+// opcodes and their operands are valid, the stack doesn't underflow or
+// overflow and exactly one value (the color) is left on it at the end. There
+// are no jumps, so a program runs at most LED_PROGRAM_SIZE_MAX instructions.
+static bool program_load(LedProgram *program, const uint8_t *code, uint8_t length) {
+    bool dynamic = false;
+    uint8_t depth = 0;
+    for (uint8_t i = 0; i < length;) {
+        uint8_t op = code[i];
+        if (op >= OP_COUNT || op_info[op].size == 0) {
+            log_error("LED program: Invalid opcode 0x%02x at %u.", op, i);
+            return false;
+        }
+
+        const OpInfo *info = &op_info[op];
+        if (i + info->size > length) {
+            log_error("LED program: Missing operand at %u.", i);
+            return false;
+        }
+        if (op == LP_OP_PALETTE && code[i + 1] >= LED_PROGRAM_PALETTE_SIZE) {
+            log_error("LED program: Invalid palette index at %u.", i);
+            return false;
+        }
+        if (depth < info->pops || depth - info->pops + info->pushes > LED_PROGRAM_STACK_SIZE) {
+            log_error("LED program: Stack underflow or overflow at %u.", i);
+            return false;
+        }
+
+        depth = depth - info->pops + info->pushes;
+        dynamic |= info->dynamic;
+        i += info->size;
+    }
+
+    if (depth != 1) {
+        log_error("LED program: %u values left on the stack, expected 1.", depth);
+        return false;
+    }
+
+    memcpy(program->code, code, length);
+    program->length = length;
+    program->dynamic = dynamic;
+    return true;
+}
+
+static uint32_t header_word(const uint8_t *code, uint8_t length) {
+    return LED_PROGRAM_MAGIC << 16 | crc16(code, length);
+}
+
+static uint32_t slot_address(const LedPrograms *lp, uint8_t slot) {
+    return lp->eeprom_address + slot * (2 + LED_PROGRAM_WORDS);
+}
+
+static bool load(LedPrograms *lp, uint8_t slot) {
+    uint32_t address = slot_address(lp, slot);
+    eeprom_var v;
+
+    if (!VESC_IF->read_eeprom_var(&v, address) || v.as_u32 >> 16 != LED_PROGRAM_MAGIC) {
+        return false;
+    }
+    uint32_t header = v.as_u32;
+
+    if (!VESC_IF->read_eeprom_var(&v, address + 1) || v.as_u32 > LED_PROGRAM_SIZE_MAX) {
+        return false;
+    }
+    uint8_t length = v.as_u32;
+
+    // read into the upload buffer, a failed load mustn't leave a partial program
+    for (uint32_t i = 0; i * 4 < length; ++i) {
+        if (!VESC_IF->read_eeprom_var(&v, address + 2 + i)) {
+            return false;
+        }
+        memcpy(&lp->upload[i * 4], &v.as_u32, 4);
+    }
+
+    if (header_word(lp->upload, length) != header) {
+        log_error("LED program %u CRC mismatch.", slot);
+        return false;
+    }
+    return program_load(&lp->programs[slot], lp->upload, length);
+}
+
+static bool store(const LedPrograms *lp, uint8_t slot) {
+    uint32_t address = slot_address(lp, slot);
+    const LedProgram *program = &lp->programs[slot];
+
+    eeprom_var v = {.as_u32 = program->length};
+    if (!VESC_IF->store_eeprom_var(&v, address + 1)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i * 4 < program->length; ++i) {
+        memcpy(&v.as_u32, &program->code[i * 4], 4);
+        if (!VESC_IF->store_eeprom_var(&v, address + 2 + i)) {
+            return false;
+        }
+    }
+
+    // the header last, an incomplete write fails the CRC check
+    v.as_u32 = header_word(program->code, program->length);
+    return VESC_IF->store_eeprom_var(&v, address);
+}
+
+static bool clear(const LedPrograms *lp, uint8_t slot) {
+    eeprom_var v = {.as_u32 = 0};
+    return VESC_IF->store_eeprom_var(&v, slot_address(lp, slot));
+}
+
+void led_programs_init(LedPrograms *lp, uint32_t eeprom_address) {
+    lp->eeprom_address = eeprom_address;
+    lp->stored_mask = 0;
+    memset(lp->upload, 0, sizeof(lp->upload));
+
+    for (uint8_t i = 0; i < LED_PROGRAM_COUNT; ++i) {
+        lp->programs[i].length = 0;
+        lp->programs[i].dynamic = false;
+        if (load(lp, i)) {
+            lp->stored_mask |= 1 << i;
+        }
+    }
+}
+
+const LedProgram *led_programs_get(const LedPrograms *lp, uint8_t slot) {
+    if (slot >= LED_PROGRAM_COUNT || lp->programs[slot].length == 0) {
+        return NULL;
+    }
+    return &lp->programs[slot];
+}
+
+static inline int32_t q16_mul(int32_t a, int32_t b) {
+    return ((int64_t) a * b) >> 16;
+}
+
+static inline int32_t q16_sat(int32_t x) {
+    return x < 0 ? 0 : x > Q16_ONE ? Q16_ONE : x;
+}
+
+static inline uint16_t q16_to_q8(int32_t x) {
+    return (q16_sat(x) + 128) >> 8;
+}
+
+static inline uint32_t q16_to_channel(int32_t x) {
+    return ((uint32_t) q16_sat(x) * 255 + Q16_ONE / 2) >> 16;
+}
+
+// Sine of `turns` full periods. A parabola over each half period, refined by
+// y + 0.225 * (y^2 - y), the error is about 0.1%.
+static int32_t q16_sin(int32_t turns) {
+    uint32_t p = (uint32_t) turns & 0xFFFF;
+    uint32_t q = p & 0x7FFF;
+    int32_t y = (q * (Q16_ONE - 2 * q)) >> 13;
+    y -= ((int64_t) (y - q16_mul(y, y)) * 14746) >> 16;
+    return p & 0x8000 ? -y : y;
+}
+
+uint32_t led_program_eval(const LedProgram *program, const LedProgramContext *ctx, uint16_t index) {
+    int32_t stack[LED_PROGRAM_STACK_SIZE];
+    int32_t *sp = stack;
+    const uint8_t *pc = program->code;
+    const uint8_t *end = pc + program->length;
+
+    // the additive operations wrap around in uint32_t, signed overflow is undefined
+    while (pc < end) {
+        switch (*pc++) {
+        case LP_OP_CONST:
+            // Q8.8 operand
+            *sp++ = (int16_t) (pc[0] << 8 | pc[1]) * 256;
+            pc += 2;
+            break;
+        case LP_OP_TIME:
+            *sp++ = ctx->time;
+            break;
+        case LP_OP_INDEX:
+            *sp++ = (int32_t) index * Q16_ONE;
+            break;
+        case LP_OP_POS:
+            *sp++ = index * ctx->pos_step;
+            break;
+        case LP_OP_LENGTH:
+            *sp++ = ctx->length;
+            break;
+        case LP_OP_SPEED:
+            *sp++ = ctx->speed;
+            break;
+        case LP_OP_DUTY:
+            *sp++ = ctx->duty;
+            break;
+        case LP_OP_PITCH:
+            *sp++ = ctx->pitch;
+            break;
+
+        case LP_OP_ADD:
+            --sp;
+            sp[-1] = (uint32_t) sp[-1] + (uint32_t) sp[0];
+            break;
+        case LP_OP_SUB:
+            --sp;
+            sp[-1] = (uint32_t) sp[-1] - (uint32_t) sp[0];
+            break;
+        case LP_OP_MUL:
+            --sp;
+            sp[-1] = q16_mul(sp[-1], sp[0]);
+            break;
+        case LP_OP_DIV:
+            --sp;
+            sp[-1] = sp[0] != 0 ? (int64_t) sp[-1] * Q16_ONE / sp[0] : 0;
+            break;
+        case LP_OP_MIN:
+            --sp;
+            sp[-1] = sp[-1] < sp[0] ? sp[-1] : sp[0];
+            break;
+        case LP_OP_MAX:
+            --sp;
+            sp[-1] = sp[-1] > sp[0] ? sp[-1] : sp[0];
+            break;
+        case LP_OP_LT:
+            --sp;
+            sp[-1] = sp[-1] < sp[0] ? Q16_ONE : 0;
+            break;
+        case LP_OP_SELECT:
+            sp -= 2;
+            sp[-1] = sp[-1] > 0 ? sp[0] : sp[1];
+            break;
+
+        case LP_OP_NEG:
+            sp[-1] = -(uint32_t) sp[-1];
+            break;
+        case LP_OP_ABS:
+            sp[-1] = sp[-1] < 0 ? -(uint32_t) sp[-1] : (uint32_t) sp[-1];
+            break;
+        case LP_OP_FRAC:
+            sp[-1] = (uint32_t) sp[-1] & 0xFFFF;
+            break;
+        case LP_OP_SIN:
+            sp[-1] = q16_sin(sp[-1]);
+            break;
+        case LP_OP_SAT:
+            sp[-1] = q16_sat(sp[-1]);
+            break;
+
+        case LP_OP_DUP:
+            sp[0] = sp[-1];
+            ++sp;
+            break;
+        case LP_OP_SWAP: {
+            int32_t tmp = sp[-1];
+            sp[-1] = sp[-2];
+            sp[-2] = tmp;
+            break;
+        }
+        case LP_OP_DROP:
+            --sp;
+            break;
+
+        case LP_OP_HUE:
+            sp[-1] = ctx->hue_palette[((uint32_t) sp[-1] >> 8) & 0xFF];
+            break;
+        case LP_OP_COLOR1:
+            *sp++ = ctx->color1;
+            break;
+        case LP_OP_COLOR2:
+            *sp++ = ctx->color2;
+            break;
+        case LP_OP_PALETTE:
+            *sp++ = ctx->palette[*pc++];
+            break;
+        case LP_OP_RGB:
+            sp -= 2;
+            sp[-1] = q16_to_channel(sp[-1]) << 16 | q16_to_channel(sp[0]) << 8 |
+                q16_to_channel(sp[1]);
+            break;
+        case LP_OP_MIX:
+            sp -= 2;
+            sp[-1] = color_blend(sp[-1], sp[0], q16_to_q8(sp[1]));
+            break;
+        case LP_OP_SCALE:
+            --sp;
+            sp[-1] = color_mix(sp[-1], q16_to_q8(sp[0]), 0, 0);
+            break;
+        }
+    }
+
+    return sp[-1];
+}
+
+typedef enum {
+    COMMAND_LED_PROGRAMS = 47,
+} LedProgramsCommands;
+
+typedef enum {
+    LP_MODE_INFO = 0,
+    LP_MODE_WRITE = 1,
+    LP_MODE_LOAD = 2,
+    LP_MODE_STORE = 3,
+    LP_MODE_CLEAR = 4,
+} LedProgramsMode;
+
+static void send_info(const LedPrograms *lp, bool ok) {
+    static const int bufsize = 8;
+    uint8_t buf[bufsize];
+    int32_t ind = 0;
+
+    uint8_t valid_mask = 0;
+    for (uint8_t i = 0; i < LED_PROGRAM_COUNT; ++i) {
+        if (lp->programs[i].length > 0) {
+            valid_mask |= 1 << i;
+        }
+    }
+
+    buf[ind++] = 101;  // Package ID
+    buf[ind++] = COMMAND_LED_PROGRAMS;
+    buf[ind++] = ok;
+    buf[ind++] = LED_PROGRAM_VERSION;
+    buf[ind++] = LED_PROGRAM_COUNT;
+    buf[ind++] = LED_PROGRAM_SIZE_MAX;
+    buf[ind++] = valid_mask;
+    buf[ind++] = lp->stored_mask;
+
+    // runs in the aux thread as a queued command
+    SEND_APP_DATA_DIRECT(buf, bufsize, ind);
+}
+
+void led_programs_request(LedPrograms *lp, uint8_t *buffer, size_t len) {
+    uint8_t mode = len > 0 ? buffer[0] : LP_MODE_INFO;
+    uint8_t slot = len > 1 ? buffer[1] : 0;
+
+    if (mode != LP_MODE_INFO && (len < 2 || slot >= LED_PROGRAM_COUNT)) {
+        log_error("LED programs: Invalid slot or command length.");
+        send_info(lp, false);
+        return;
+    }
+
+    bool ok = true;
+    switch (mode) {
+    case LP_MODE_INFO:
+        break;
+    case LP_MODE_WRITE: {
+        uint8_t offset = len > 2 ? buffer[2] : 0;
+        size_t size = len > 3 ? len - 3 : 0;
+        if (len < 3 || offset + size > LED_PROGRAM_SIZE_MAX) {
+            log_error("LED programs: Write out of bounds.");
+            ok = false;
+        } else {
+            memcpy(&lp->upload[offset], &buffer[3], size);
+        }
+        break;
+    }
+    case LP_MODE_LOAD: {
+        uint8_t length = len > 2 ? buffer[2] : 0;
+        // on failure the slot keeps its previous program
+        LedProgram program;
+        ok = length <= LED_PROGRAM_SIZE_MAX && program_load(&program, lp->upload, length);
+        if (ok) {
+            lp->programs[slot] = program;
+            lp->stored_mask &= ~(1 << slot);
+        } else {
+            log_error("LED programs: Failed to load slot %u.", slot);
+        }
+        break;
+    }
+    case LP_MODE_STORE:
+        ok = lp->programs[slot].length > 0 && store(lp, slot);
+        if (ok) {
+            lp->stored_mask |= 1 << slot;
+        } else {
+            log_error("LED programs: Failed to store slot %u.", slot);
+            lp->stored_mask &= ~(1 << slot);
+        }
+        break;
+    case LP_MODE_CLEAR:
+        lp->programs[slot].length = 0;
+        lp->programs[slot].dynamic = false;
+        ok = clear(lp, slot);
+        lp->stored_mask &= ~(1 << slot);
+        break;
+    default:
+        log_error("LED programs: Unknown mode %u.", mode);
+        ok = false;
+    }
+
+    send_info(lp, ok);
+}
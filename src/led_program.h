@@ -0,0 +1,120 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "conf/datatypes.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LED_PROGRAM_COUNT 2
+#define LED_PROGRAM_SIZE_MAX 64
+#define LED_PROGRAM_STACK_SIZE 8
+#define LED_PROGRAM_VERSION 1
+
+// The program palette are the colors of the LedColor config options
+#define LED_PROGRAM_PALETTE_SIZE (COLOR_LAVENDER + 1)
+
+// Opcodes of the LED program bytecode, see doc/commands/LED_PROGRAMS.md.
+typedef enum {
+    LP_OP_CONST = 0x01,
+    LP_OP_TIME = 0x02,
+    LP_OP_INDEX = 0x03,
+    LP_OP_POS = 0x04,
+    LP_OP_LENGTH = 0x05,
+    LP_OP_SPEED = 0x06,
+    LP_OP_DUTY = 0x07,
+    LP_OP_PITCH = 0x08,
+
+    LP_OP_ADD = 0x10,
+    LP_OP_SUB = 0x11,
+    LP_OP_MUL = 0x12,
+    LP_OP_DIV = 0x13,
+    LP_OP_MIN = 0x14,
+    LP_OP_MAX = 0x15,
+    LP_OP_LT = 0x16,
+    LP_OP_SELECT = 0x17,
+
+    LP_OP_NEG = 0x20,
+    LP_OP_ABS = 0x21,
+    LP_OP_FRAC = 0x22,
+    LP_OP_SIN = 0x23,
+    LP_OP_SAT = 0x24,
+
+    LP_OP_DUP = 0x28,
+    LP_OP_SWAP = 0x29,
+    LP_OP_DROP = 0x2A,
+
+    LP_OP_HUE = 0x30,
+    LP_OP_COLOR1 = 0x31,
+    LP_OP_COLOR2 = 0x32,
+    LP_OP_PALETTE = 0x33,
+    LP_OP_RGB = 0x34,
+    LP_OP_MIX = 0x35,
+    LP_OP_SCALE = 0x36,
+} LedProgramOp;
+
+// A validated program, it doesn't need any checks when it runs.
+typedef struct {
+    uint8_t code[LED_PROGRAM_SIZE_MAX];
+    uint8_t length;  // 0 for an empty slot
+    // whether the program reads the time or the ride inputs, i.e. needs to be
+    // rendered continuously
+    bool dynamic;
+} LedProgram;
+
+// The inputs of a program run over a strip, numbers are Q16.16 fixed point.
+typedef struct {
+    int32_t time;
+    int32_t length;
+    int32_t pos_step;
+    int32_t speed;
+    int32_t duty;
+    int32_t pitch;
+    uint32_t color1;
+    uint32_t color2;
+    const uint32_t *palette;
+    const uint32_t *hue_palette;
+} LedProgramContext;
+
+// LED programs held in RAM, each of the slots can also be stored in the EEPROM
+// at eeprom_address + slot * (2 + LED_PROGRAM_WORDS) as a header word (a
+// magic number and a CRC), a length word and the code. The stored programs are
+// loaded on startup.
+//
+// Programs are uploaded in chunks into the upload buffer and loaded into a
+// slot once complete, all of which happens in the aux thread, which is also
+// where they run.
+typedef struct {
+    uint32_t eeprom_address;
+    LedProgram programs[LED_PROGRAM_COUNT];
+    uint8_t stored_mask;
+    uint8_t upload[LED_PROGRAM_SIZE_MAX];
+} LedPrograms;
+
+void led_programs_init(LedPrograms *lp, uint32_t eeprom_address);
+
+const LedProgram *led_programs_get(const LedPrograms *lp, uint8_t slot);
+
+/**
+ * Evaluates the program for the LED at `index`, returns its color.
+ */
+uint32_t led_program_eval(const LedProgram *program, const LedProgramContext *ctx, uint16_t index);
+
+void led_programs_request(LedPrograms *lp, uint8_t *buffer, size_t len);
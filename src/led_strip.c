@@ -24,6 +24,7 @@ void led_strip_init(LedStrip *strip) {
     strip->length = 0;
     strip->color_order = LED_COLOR_GRB;
     strip->reverse = false;
+    memset(&strip->trans_data, 0, sizeof(TransitionData));
 }
 
 void led_strip_configure(LedStrip *strip, const CfgLedStrip *cfg) {
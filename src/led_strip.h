@@ -22,10 +22,12 @@
 #include <stdint.h>
 
 #define STRIP_COUNT 3
-#define LEDS_FRONT_AND_REAR_COUNT_MAX 60
+#define LED_STRIP_LENGTH_MAX 512
 
 typedef struct {
-    uint8_t map[LEDS_FRONT_AND_REAR_COUNT_MAX];
+    // shuffled LED indices for the two halves of the transition, 2 * length items,
+    // only allocated while the transition is running
+    uint16_t *map;
 } CipherData;
 
 typedef union {
@@ -34,7 +36,7 @@ typedef union {
 
 typedef struct {
     uint32_t *data;
-    uint8_t length;
+    uint16_t length;
     LedColorOrder color_order;
     bool reverse;
     float brightness;
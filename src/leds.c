@@ -18,28 +18,26 @@
 #include "leds.h"
 
 #include "conf/datatypes.h"
+#include "led_color.h"
 #include "led_driver.h"
+#include "led_hue_palette.h"
 #include "lib/utils.h"
 
 #include "vesc_c_if.h"
 
+#include <float.h>
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
-// Brightness change rate
-#define BR_RATE (3.0f / LEDS_REFRESH_RATE)
-// Footpad Sensor change rate
-#define FS_RATE (10.0f / LEDS_REFRESH_RATE)
-// Status Bar change rate
-#define SB_RATE (5.0f / LEDS_REFRESH_RATE)
-
-#define R(c) ((uint8_t) ((c) >> 16))
-#define G(c) ((uint8_t) ((c) >> 8))
-#define B(c) ((uint8_t) (c))
-#define W(c) ((uint8_t) ((c) >> 24))
+// Brightness change rate per second
+#define BR_RATE 3.0f
+// Footpad Sensor change rate per second
+#define FS_RATE 10.0f
+// Status Bar change rate per second
+#define SB_RATE 5.0f
+
 #define RGB(r, g, b) ((r) << 16 | (g) << 8 | (b))
-#define RGBW(r, g, b, w) ((w) << 24 | (r) << 16 | (g) << 8 | (b))
 
 static const uint32_t colors[] = {
     0x00000000,  // BLACK
@@ -87,22 +85,11 @@ static const uint32_t colors[] = {
 
 #define CONFIRM_ANIMATION_DURATION 0.8f
 
-static uint32_t color_blend(uint32_t color1, uint32_t color2, float blend) {
-    if (blend <= 0.0f) {
-        return color1;
-    } else if (blend >= 1.0f) {
-        return color2;
-    }
-
-    float blend1 = 1.0f - blend;
+#define FELONY_STATE_DURATION 0.05f
+#define RAINBOW_CYCLE_COUNT 10
 
-    uint8_t r = R(color1) * blend1 + R(color2) * blend;
-    uint8_t g = G(color1) * blend1 + G(color2) * blend;
-    uint8_t b = B(color1) * blend1 + B(color2) * blend;
-    uint8_t w = W(color1) * blend1 + W(color2) * blend;
-
-    return RGBW(r, g, b, w);
-}
+// Time after which a static scene is rendered again
+#define IDLE_UPDATE_PERIOD 1.0f
 
 // Bhaskara cosine approximation.
 // Returns a cosine wave oscillating from 0 to 1, starting at 0, with a period of 2s:
@@ -119,33 +106,14 @@ static float cosine_progress(float time) {
     }
 }
 
-// Tweaks the color channel value to make the hue more uniform.
-static float tweak_color(float x, float a) {
-    if (x < 1.0f) {
-        return 1.0f - powf(1.0f - x, a);
-    } else if (x < 2.0f) {
-        return 1.0f + powf(x - 1.0f, a);
-    }
-    return 0.0f;
+static inline uint32_t hue_color(uint8_t hue) {
+    return hue_palette[hue];
 }
 
-// Returns color for hue in range [0..255].
-static uint32_t hue_to_color(uint8_t hue) {
-    float norm = (float) hue / 255.0f * 3.0f;
-    float r_norm = fmodf(norm + 0.5f, 3.0f);
-    float g_norm = fmodf(norm + 2.5f, 3.0f);
-    float b_norm = fmodf(norm + 1.5f, 3.0f);
-    float r = cosine_progress(tweak_color(r_norm, 3.2f));
-    float g = cosine_progress(tweak_color(g_norm, 2.4f));
-    float b = cosine_progress(tweak_color(b_norm, 2.2f));
-
-    return ((uint8_t) (r * 255) << 16) | ((uint8_t) (g * 255) << 8) | (uint8_t) (b * 255);
-}
-
-static void sattolo_shuffle(uint32_t seed, uint8_t *array, uint8_t length) {
+static void sattolo_shuffle(uint32_t seed, uint16_t *array, uint16_t length) {
     for (int16_t i = length - 1; i > 0; --i) {
-        uint8_t j = rnd(seed + i) % i;
-        uint8_t t = array[i];
+        uint16_t j = rnd(seed + i) % i;
+        uint16_t t = array[i];
         array[i] = array[j];
         array[j] = t;
     }
@@ -161,14 +129,53 @@ static void full_animation_reset(Leds *leds, float current_time) {
     leds->status_on_front_idle_time = current_time;
 }
 
-static void led_set_color(
-    Leds *leds, const LedStrip *strip, uint8_t i, uint32_t color, float brightness, float blend
-) {
-    if (blend <= 0.0f) {
+// Requests the next frame to be rendered at `time` at the latest.
+static void request_frame(Leds *leds, float time) {
+    if (time < leds->next_update) {
+        leds->next_update = time;
+    }
+}
+
+// The shortest period between two frames. Sending a frame blocks the aux
+// thread, long strips are limited to a frame rate at which at most half of
+// the time is spent sending.
+static float min_frame_period(const Leds *leds) {
+    return fmaxf(1.0f / LEDS_REFRESH_RATE_MAX, 2.0f * led_driver_frame_duration(&leds->led_driver));
+}
+
+// Requests the next frame as soon as possible, for a scene in motion.
+static void request_next_frame(Leds *leds) {
+    request_frame(leds, leds->last_updated + min_frame_period(leds));
+}
+
+static void leds_rate_limit(Leds *leds, float *value, float target, float rate) {
+    rate_limitf(value, target, rate * leds->frame_time);
+    if (*value != target) {
+        request_next_frame(leds);
+    }
+}
+
+// The weights of the new and the current color of an LED
+typedef struct {
+    uint16_t color;  // brightness * on_off_fade * blend
+    uint16_t orig;  // 1 - blend
+} LedFactors;
+
+static LedFactors led_factors(const Leds *leds, float brightness, float blend) {
+    // brightness can't exceed 1, so .color + .orig doesn't exceed Q8_ONE
+    float br = fminf(brightness * leds->on_off_fade, 1.0f);
+    return (LedFactors) {
+        .color = to_q8(br * blend),
+        .orig = Q8_ONE - to_q8(blend),
+    };
+}
+
+static void led_set(const LedStrip *strip, uint16_t i, uint32_t color, LedFactors f) {
+    if (f.orig == Q8_ONE) {
         return;
     }
 
-    uint8_t led = i;
+    uint16_t led = i;
     if (strip->reverse) {
         led = strip->length - i - 1;
     }
@@ -177,24 +184,14 @@ static void led_set_color(
         return;
     }
 
-    float br = brightness * leds->on_off_fade;
-
-    uint8_t r = R(color) * br + 0.5f;
-    uint8_t g = G(color) * br + 0.5f;
-    uint8_t b = B(color) * br + 0.5f;
-    uint8_t w = W(color) * br + 0.5f;
-
-    if (blend < 1.0f) {
-        uint32_t orig_color = strip->data[led];
-        float orig_blend = 1.0f - blend;
-
-        r = r * blend + R(orig_color) * orig_blend;
-        g = g * blend + G(orig_color) * orig_blend;
-        b = b * blend + B(orig_color) * orig_blend;
-        w = w * blend + W(orig_color) * orig_blend;
-    }
+    uint32_t orig_color = f.orig > 0 ? strip->data[led] : 0;
+    strip->data[led] = color_mix(color, f.color, orig_color, f.orig);
+}
 
-    strip->data[led] = RGBW(r, g, b, w);
+static void led_set_color(
+    Leds *leds, const LedStrip *strip, uint16_t i, uint32_t color, float brightness, float blend
+) {
+    led_set(strip, i, color, led_factors(leds, brightness, blend));
 }
 
 static void strip_set_color_range(
@@ -203,12 +200,13 @@ static void strip_set_color_range(
     uint32_t color,
     float brightness,
     float blend,
-    uint8_t idx_start,
-    uint8_t idx_end
+    uint16_t idx_start,
+    uint16_t idx_end
 ) {
-    uint8_t end = idx_end < strip->length ? idx_end : strip->length;
-    for (uint8_t i = idx_start; i < end; ++i) {
-        led_set_color(leds, strip, i, color, brightness, blend);
+    LedFactors f = led_factors(leds, brightness, blend);
+    uint16_t end = idx_end < strip->length ? idx_end : strip->length;
+    for (uint16_t i = idx_start; i < end; ++i) {
+        led_set(strip, i, color, f);
     }
 }
 
@@ -220,7 +218,7 @@ static void strip_set_color(
 
 static void anim_fade(Leds *leds, const LedStrip *strip, const LedBar *bar, float time) {
     float p = cosine_progress(time);
-    uint32_t color = color_blend(colors[bar->color2], colors[bar->color1], p);
+    uint32_t color = color_blend(colors[bar->color2], colors[bar->color1], to_q8(p));
     strip_set_color(leds, strip, color, strip->brightness, 1.0f);
 }
 
@@ -244,27 +242,29 @@ static void anim_pulse(
         fade = time / ratio;
     }
 
-    for (uint8_t i = 0; i < strip->length; ++i) {
+    LedFactors f = led_factors(leds, strip->brightness, 1.0f);
+    for (uint16_t i = 0; i < strip->length; ++i) {
         float dist1 = i - offset + 1.0f;
         float dist2 = strip->length - offset - i;
         float k1 = clampf(dist1 / feather, 0.0f, 1.0f);
         float k2 = clampf(dist2 / feather, 0.0f, 1.0f);
 
         uint32_t color =
-            color_blend(colors[bar->color2], colors[bar->color1], fminf(k1, k2) * fade);
-        led_set_color(leds, strip, i, color, strip->brightness, 1.0f);
+            color_blend(colors[bar->color2], colors[bar->color1], to_q8(fminf(k1, k2) * fade));
+        led_set(strip, i, color, f);
     }
 }
 
 static void anim_knight_rider(Leds *leds, const LedStrip *strip, const LedBar *bar, float time) {
-    const uint8_t tail = strip->length / 3 + 1;
+    const uint16_t tail = strip->length / 3 + 1;
 
     time *= 0.7f;
     float backlight = time > 0.3f ? 0.08f : 0.0f;
     float x1 = strip->length * fmodf(time, 2.0f) - 0.5f * strip->length - 1.0f;
     float x2 = 1.5f * strip->length - strip->length * fmodf(time - 1.0f, 2.0f);
 
-    for (uint8_t i = 0; i < strip->length; ++i) {
+    LedFactors f = led_factors(leds, strip->brightness, 1.0f);
+    for (uint16_t i = 0; i < strip->length; ++i) {
         float k1 = backlight;
         float dist1 = fabsf(x1 - i);
         if (i <= x1) {
@@ -285,21 +285,21 @@ static void anim_knight_rider(Leds *leds, const LedStrip *strip, const LedBar *b
             k2 = 1 - x2 + floorf(x2);
         }
 
-        uint32_t color = color_blend(colors[bar->color2], colors[bar->color1], fmaxf(k1, k2));
-        led_set_color(leds, strip, i, color, strip->brightness, 1.0f);
+        uint32_t color =
+            color_blend(colors[bar->color2], colors[bar->color1], to_q8(fmaxf(k1, k2)));
+        led_set(strip, i, color, f);
     }
 }
 
 static void anim_felony(Leds *leds, const LedStrip *strip, const LedBar *bar, float time) {
     static const uint32_t color_off = 0x00000000;
 
-    static const float state_duration = 0.05f;
-    float state_mod = fmodf(time, 3.0f * state_duration);
+    float state_mod = fmodf(time, 3.0f * FELONY_STATE_DURATION);
 
     // also account for led strips with odd numbers of leds (leaving the middle one black)
-    uint8_t stop_idx = strip->length / 2;
-    uint8_t start_idx = strip->length / 2 + strip->length % 2;
-    if (state_mod < state_duration) {
+    uint16_t stop_idx = strip->length / 2;
+    uint16_t start_idx = strip->length / 2 + strip->length % 2;
+    if (state_mod < FELONY_STATE_DURATION) {
         strip_set_color_range(
             leds, strip, colors[bar->color1], strip->brightness, 1.0f, 0, stop_idx
         );
@@ -307,7 +307,7 @@ static void anim_felony(Leds *leds, const LedStrip *strip, const LedBar *bar, fl
         strip_set_color_range(
             leds, strip, color_off, strip->brightness, 1.0f, start_idx, strip->length
         );
-    } else if (state_mod < 2.0f * state_duration) {
+    } else if (state_mod < 2.0f * FELONY_STATE_DURATION) {
         strip_set_color_range(leds, strip, color_off, strip->brightness, 1.0f, 0, stop_idx);
         strip_set_color_range(leds, strip, color_off, strip->brightness, 1.0f, stop_idx, start_idx);
         strip_set_color_range(
@@ -325,38 +325,69 @@ static void anim_felony(Leds *leds, const LedStrip *strip, const LedBar *bar, fl
 }
 
 static void anim_rainbow_cycle(Leds *leds, const LedStrip *strip, float time) {
-    const uint8_t count = 10;
-    const float segment = 255.0f / count;
-    uint8_t color_idx = ((uint8_t) (time * count) % count) * segment;
-    strip_set_color(leds, strip, hue_to_color(color_idx), strip->brightness, 1.0f);
+    const float segment = 255.0f / RAINBOW_CYCLE_COUNT;
+    uint8_t color_idx = ((uint8_t) (time * RAINBOW_CYCLE_COUNT) % RAINBOW_CYCLE_COUNT) * segment;
+    strip_set_color(leds, strip, hue_color(color_idx), strip->brightness, 1.0f);
 }
 
 static void anim_rainbow_fade(Leds *leds, const LedStrip *strip, float time) {
     uint8_t offset = fmodf(time, 1.0f) * 255.0f;
-    strip_set_color(leds, strip, hue_to_color(offset), strip->brightness, 1.0f);
+    strip_set_color(leds, strip, hue_color(offset), strip->brightness, 1.0f);
 }
 
 static void anim_rainbow_roll(Leds *leds, const LedStrip *strip, float time) {
     uint8_t offset = fmodf(time, 1.0f) * 255.0f;
-    for (int i = 0; i < strip->length; ++i) {
-        led_set_color(
-            leds,
-            strip,
-            i,
-            hue_to_color(255.0f / strip->length * i + offset),
-            strip->brightness,
-            1.0f
-        );
+    LedFactors f = led_factors(leds, strip->brightness, 1.0f);
+    for (uint16_t i = 0; i < strip->length; ++i) {
+        led_set(strip, i, hue_color(255.0f / strip->length * i + offset), f);
+    }
+}
+
+static void anim_program(
+    Leds *leds, const LedStrip *strip, const LedBar *bar, uint8_t slot, float time
+) {
+    const LedProgram *program = led_programs_get(&leds->programs, slot);
+    if (!program || strip->length == 0) {
+        strip_set_color(leds, strip, colors[bar->color1], strip->brightness, 1.0f);
+        return;
+    }
+
+    // wrap the time to keep it in range of the fixed point, a multiple of the
+    // periods of FRAC and SIN, so they don't jump
+    const float time_wrap = 1024.0f;
+
+    LedProgramContext ctx = {
+        .time = fmodf(time, time_wrap) * 65536.0f,
+        .length = strip->length * 65536,
+        .pos_step = 65536 / strip->length,
+        .speed = clampf(leds->speed, -1000.0f, 1000.0f) * 65536.0f,
+        .duty = clampf(leds->duty, 0.0f, 1.0f) * 65536.0f,
+        .pitch = clampf(leds->pitch, -180.0f, 180.0f) * 65536.0f,
+        .color1 = colors[bar->color1],
+        .color2 = colors[bar->color2],
+        .palette = colors,
+        .hue_palette = hue_palette,
+    };
+
+    LedFactors f = led_factors(leds, strip->brightness, 1.0f);
+    for (uint16_t i = 0; i < strip->length; ++i) {
+        led_set(strip, i, led_program_eval(program, &ctx, i), f);
+    }
+
+    if (program->dynamic) {
+        request_next_frame(leds);
     }
 }
 
 static void led_strip_animate(Leds *leds, const LedStrip *strip, const LedBar *bar, float time) {
     time *= bar->speed;
 
+    // the time step in which the animation changes, 0 for continuous animations
+    float step = 0.0f;
     switch (bar->mode) {
     case LED_ANIM_SOLID:
         strip_set_color(leds, strip, colors[bar->color1], strip->brightness, 1.0f);
-        break;
+        return;
     case LED_ANIM_FADE:
         anim_fade(leds, strip, bar, time);
         break;
@@ -365,15 +396,18 @@ static void led_strip_animate(Leds *leds, const LedStrip *strip, const LedBar *b
         break;
     case LED_ANIM_STROBE:
         anim_strobe(leds, strip, bar, time);
+        step = 1.0f;
         break;
     case LED_ANIM_KNIGHT_RIDER:
         anim_knight_rider(leds, strip, bar, time);
         break;
     case LED_ANIM_FELONY:
         anim_felony(leds, strip, bar, time);
+        step = FELONY_STATE_DURATION;
         break;
     case LED_ANIM_RAINBOW_CYCLE:
         anim_rainbow_cycle(leds, strip, time);
+        step = 1.0f / RAINBOW_CYCLE_COUNT;
         break;
     case LED_ANIM_RAINBOW_FADE:
         anim_rainbow_fade(leds, strip, time);
@@ -381,18 +415,31 @@ static void led_strip_animate(Leds *leds, const LedStrip *strip, const LedBar *b
     case LED_ANIM_RAINBOW_ROLL:
         anim_rainbow_roll(leds, strip, time);
         break;
+    case LED_ANIM_PROGRAM_1:
+    case LED_ANIM_PROGRAM_2:
+        // requests its frames itself, the program can also depend on the ride
+        anim_program(leds, strip, bar, bar->mode - LED_ANIM_PROGRAM_1, time);
+        return;
+    }
+
+    if (bar->speed <= 0.0f) {
+        return;
+    } else if (step > 0.0f) {
+        request_frame(leds, leds->last_updated + (step - fmodf(time, step)) / bar->speed);
+    } else {
+        request_next_frame(leds);
     }
 }
 
 static void anim_fs_state(Leds *leds, const LedStrip *strip, bool reverse, float blend) {
-    uint8_t offset = (strip->length + 1) / 2 - 1;
-    uint8_t right_offset = strip->length - offset - 1;
+    uint16_t offset = (strip->length + 1) / 2 - 1;
+    uint16_t right_offset = strip->length - offset - 1;
 
     // need to reverse for displaying on the front bar
     float left_sensor = reverse ? leds->right_sensor : leds->left_sensor;
     float right_sensor = reverse ? leds->left_sensor : leds->right_sensor;
 
-    for (uint8_t i = 0; i < strip->length; ++i) {
+    for (uint16_t i = 0; i < strip->length; ++i) {
         uint32_t color = 0;
         float dim = 0.0f;
 
@@ -429,12 +476,12 @@ static void anim_progress_bar(
     float blend
 ) {
     float progress = strip->length * value;
-    uint8_t offset = progress;
+    uint16_t offset = progress;
     // last tick at proportional brightness, need to lower it, otherwise it's hard to distinguish
     float remaining = (progress - floorf(progress)) * 0.7f;
 
-    uint8_t red_offset = 0;
-    uint8_t red_led_nr = roundf(strip->length * leds->cfg->status.red_bar_percentage);
+    uint16_t red_offset = 0;
+    uint16_t red_led_nr = roundf(strip->length * leds->cfg->status.red_bar_percentage);
     if (color_end) {
         red_offset = strip->length - red_led_nr;
     } else {
@@ -443,7 +490,7 @@ static void anim_progress_bar(
         }
     }
 
-    for (uint8_t i = 0; i < strip->length; ++i) {
+    for (uint16_t i = 0; i < strip->length; ++i) {
         uint32_t col = 0;
         float dim = 1.0f;
         if (i <= offset) {
@@ -457,7 +504,7 @@ static void anim_progress_bar(
             }
         }
 
-        uint8_t led = reverse ? strip->length - i - 1 : i;
+        uint16_t led = reverse ? strip->length - i - 1 : i;
         led_set_color(leds, strip, led, col, strip->brightness * dim, blend);
     }
 }
@@ -470,9 +517,10 @@ static void anim_battery_bar(
 
     float blink_threshold = 1.0f / strip->length;
     if (battery <= blink_threshold) {
-        uint8_t led = reverse ? strip->length - 1 : 0;
+        uint16_t led = reverse ? strip->length - 1 : 0;
         float blink = 0.15f + 0.85f * cosine_progress(current_time * 2.0f);
         led_set_color(leds, strip, led, BATTERY10_BAR_COLOR, strip->brightness * blink, blend);
+        request_next_frame(leds);
     }
 }
 
@@ -522,7 +570,8 @@ static void anim_confirm(Leds *leds, const LedStrip *strip, float time) {
     float offset = sides + length * (1.0f - p);
     float feather = strip->length * 0.25f;
 
-    for (uint8_t i = 0; i < strip->length; ++i) {
+    LedFactors f = led_factors(leds, strip->brightness, blend);
+    for (uint16_t i = 0; i < strip->length; ++i) {
         float d;
         if (i < strip->length * 0.5f) {
             d = i - offset + 1.0f;
@@ -530,9 +579,8 @@ static void anim_confirm(Leds *leds, const LedStrip *strip, float time) {
             d = strip->length - offset - i;
         }
 
-        float k = clampf(d / feather, 0.0f, 1.0f);
-        uint32_t color = color_blend(COLOR_BLACK, CONFIRM_COLOR, k);
-        led_set_color(leds, strip, i, color, strip->brightness, blend);
+        uint32_t color = color_blend(COLOR_BLACK, CONFIRM_COLOR, to_q8(d / feather));
+        led_set(strip, i, color, f);
     }
 }
 
@@ -560,9 +608,9 @@ static void status_animate(
     float motor_utilization = fmaxf(duty, fmaxf(motor_current, battery_current));
     // 10 percent hysteresis
     if (motor_utilization > leds->motor_utilization_threshold) {
-        rate_limitf(&leds->status_utilization_blend, 1.0f, SB_RATE);
+        leds_rate_limit(leds, &leds->status_utilization_blend, 1.0f, SB_RATE);
     } else if (motor_utilization < leds->motor_utilization_threshold - 0.1f) {
-        rate_limitf(&leds->status_utilization_blend, 0.0f, SB_RATE);
+        leds_rate_limit(leds, &leds->status_utilization_blend, 0.0f, SB_RATE);
     }
 
     if (idle_blend > 0.0f) {
@@ -614,16 +662,39 @@ static void status_animate(
         (current_time - leds->confirm_animation_start) * (1.0f / CONFIRM_ANIMATION_DURATION);
     if (conf_prog <= 1.0f) {
         anim_confirm(leds, strip, conf_prog);
+        request_next_frame(leds);
     }
 }
 
-static void transition_reset(const Leds *leds, TransitionState *trans, LedStrip *strip) {
+static uint16_t *trans_pool_alloc(TransitionPool *pool, uint16_t size) {
+    if (pool->used + size > pool->size) {
+        return NULL;
+    }
+
+    uint16_t *ptr = pool->buffer + pool->used;
+    pool->used += size;
+    return ptr;
+}
+
+static void transitions_release(Leds *leds) {
+    leds->trans_pool.used = 0;
+    memset(&leds->front_strip.trans_data, 0, sizeof(TransitionData));
+    memset(&leds->rear_strip.trans_data, 0, sizeof(TransitionData));
+}
+
+static void transition_reset(Leds *leds, TransitionState *trans, LedStrip *strip) {
     switch (trans->transition) {
     case LED_TRANS_CIPHER:
     case LED_TRANS_MONO_CIPHER: {
         CipherData *data = &strip->trans_data.cipher;
+        if (!data->map) {
+            data->map = trans_pool_alloc(&leds->trans_pool, 2 * strip->length);
+            if (!data->map) {
+                break;
+            }
+        }
 
-        for (uint8_t i = 0; i < strip->length; ++i) {
+        for (uint16_t i = 0; i < strip->length; ++i) {
             data->map[i] = i;
             data->map[i + strip->length] = i;
         }
@@ -656,7 +727,8 @@ static void trans_fade_out_in(
         float brightness = strip->brightness + (to_bar->brightness - strip->brightness) * prog;
         strip_set_color(leds, strip, 0x00000000, brightness, prog);
     } else {
-        uint32_t to_color = color_blend(0x00000000, colors[led_bar_to_color(to_bar)], progress);
+        uint32_t to_color =
+            color_blend(0x00000000, colors[led_bar_to_color(to_bar)], to_q8(progress));
         float brightness = strip->brightness + (to_bar->brightness - strip->brightness) * progress;
         strip_set_color(leds, strip, to_color, brightness, 1.0f);
     }
@@ -671,15 +743,22 @@ static void trans_cipher(
     bool mono
 ) {
     const CipherData *data = &strip->trans_data.cipher;
-    int8_t prog = progress * strip->length;
+    if (!data->map) {
+        trans_fade(leds, strip, progress, to_bar);
+        return;
+    }
+
+    int16_t prog = progress * strip->length;
 
     uint32_t to_color = colors[led_bar_to_color(to_bar)];
     float mid_brightness = (strip->brightness + to_bar->brightness) / 2.0f;
+    LedFactors mid_f = led_factors(leds, mid_brightness, 1.0f);
+    LedFactors to_f = led_factors(leds, to_bar->brightness, 1.0f);
 
-    for (int8_t i = 1 - strip->length; i <= prog; ++i) {
+    for (int16_t i = 1 - strip->length; i <= prog; ++i) {
         if (i <= 0) {
-            uint8_t j = -i;
-            uint8_t target_j = data->map[j];
+            uint16_t j = -i;
+            uint16_t target_j = data->map[j];
             uint8_t r = rnd(j + target_j) % 256;
             uint32_t color;
 
@@ -688,19 +767,17 @@ static void trans_cipher(
                 color = 0x00000000;
             } else {
                 if (mono) {
-                    color = color_blend(colors[from_bar->color1], to_color, r / 256.0f);
+                    color = color_blend(colors[from_bar->color1], to_color, r);
                 } else {
                     // random fade to white
                     uint8_t wf = rnd(j + target_j + 23) % 128 + 80;
-                    color = hue_to_color(r) | RGB(wf, wf, wf);
+                    color = hue_color(r) | RGB(wf, wf, wf);
                 }
             }
 
-            led_set_color(leds, strip, target_j, color, mid_brightness, 1.0f);
+            led_set(strip, target_j, color, mid_f);
         } else {
-            led_set_color(
-                leds, strip, data->map[i - 1 + strip->length], to_color, to_bar->brightness, 1.0f
-            );
+            led_set(strip, data->map[i - 1 + strip->length], to_color, to_f);
         }
     }
 }
@@ -785,10 +862,19 @@ void leds_init(Leds *leds) {
     led_strip_init(&leds->rear_strip);
 
     leds->led_data = NULL;
+    leds->trans_pool.buffer = NULL;
+    leds->trans_pool.size = 0;
+    leds->trans_pool.used = 0;
 
     leds->last_updated = 0.0f;
+    leds->next_update = 0.0f;
+    leds->update_requested = false;
+    leds->frame_time = 0.0f;
     state_init(&leds->state);
+    leds->fs_state = FS_NONE;
     leds->pitch = 0.0f;
+    leds->speed = 0.0f;
+    leds->duty = 0.0f;
 
     leds->left_sensor = 0.0f;
     leds->right_sensor = 0.0f;
@@ -836,44 +922,74 @@ void leds_init(Leds *leds) {
     led_driver_init(&leds->led_driver);
 }
 
+static LedPin strip_pin(const CfgHwLeds *hw_cfg, const CfgLedStrip *strip_cfg) {
+    if (strip_cfg->pin == LED_STRIP_PIN_DEFAULT) {
+        return hw_cfg->pin;
+    }
+    return strip_cfg->pin - LED_STRIP_PIN_B6;
+}
+
 void leds_setup(Leds *leds, CfgHwLeds *hw_cfg, const CfgLeds *cfg) {
-    uint8_t status_offset = 0;
-    uint8_t front_offset = 0;
-    uint8_t rear_offset = 0;
-    uint8_t current_offset = 0;
+    uint16_t status_offset = 0;
+    uint16_t front_offset = 0;
+    uint16_t rear_offset = 0;
+    uint16_t current_offset = 0;
 
     const LedStrip *strip_array[STRIP_COUNT] = {NULL};
+    LedPin strip_pins[STRIP_COUNT] = {0};
     size_t strip_i = 0;
     for (uint8_t i = 1; i <= STRIP_COUNT; ++i) {
         if (hw_cfg->status.order == i && hw_cfg->status.count > 0) {
             led_strip_configure(&leds->status_strip, &hw_cfg->status);
             status_offset = current_offset;
             current_offset += leds->status_strip.length;
+            strip_pins[strip_i] = strip_pin(hw_cfg, &hw_cfg->status);
             strip_array[strip_i++] = &leds->status_strip;
         } else if (hw_cfg->front.order == i && hw_cfg->front.count > 0) {
             led_strip_configure(&leds->front_strip, &hw_cfg->front);
             front_offset = current_offset;
             current_offset += leds->front_strip.length;
+            strip_pins[strip_i] = strip_pin(hw_cfg, &hw_cfg->front);
             strip_array[strip_i++] = &leds->front_strip;
         } else if (hw_cfg->rear.order == i && hw_cfg->rear.count > 0) {
             led_strip_configure(&leds->rear_strip, &hw_cfg->rear);
             rear_offset = current_offset;
             current_offset += leds->rear_strip.length;
+            strip_pins[strip_i] = strip_pin(hw_cfg, &hw_cfg->rear);
             strip_array[strip_i++] = &leds->rear_strip;
         }
     }
 
-    uint8_t led_count =
+    uint16_t led_count =
         leds->status_strip.length + leds->front_strip.length + leds->rear_strip.length;
+    // the front and rear strips can run a cipher transition, which needs 2 indices per LED
+    uint16_t trans_pool_size = 2 * (leds->front_strip.length + leds->rear_strip.length);
 
     uint32_t *led_data = NULL;
-    if (leds->front_strip.length + leds->rear_strip.length > LEDS_FRONT_AND_REAR_COUNT_MAX) {
-        log_error("Front and rear LED counts exceed maximum.");
+    if (leds->status_strip.length > LED_STRIP_LENGTH_MAX ||
+        leds->front_strip.length > LED_STRIP_LENGTH_MAX ||
+        leds->rear_strip.length > LED_STRIP_LENGTH_MAX) {
+        log_error("LED strip length exceeds maximum.");
     } else if (hw_cfg->mode & LED_MODE_INTERNAL && led_count > 0) {
         led_data = VESC_IF->malloc(sizeof(uint32_t) * led_count);
-        if (!led_data) {
+        // the pool is kept for the lifetime of the setup; with only a status
+        // strip there is nothing to allocate and a NULL pool is valid
+        if (trans_pool_size > 0) {
+            leds->trans_pool.buffer = VESC_IF->malloc(sizeof(uint16_t) * trans_pool_size);
+        }
+        if (!led_data || (trans_pool_size > 0 && !leds->trans_pool.buffer)) {
             log_error("Failed to init LED data, out of memory.");
+            if (led_data) {
+                VESC_IF->free(led_data);
+                led_data = NULL;
+            }
+            if (leds->trans_pool.buffer) {
+                VESC_IF->free(leds->trans_pool.buffer);
+                leds->trans_pool.buffer = NULL;
+            }
         } else {
+            leds->trans_pool.size = trans_pool_size;
+
             memset(led_data, 0, sizeof(uint32_t) * led_count);
             leds->status_strip.data = led_data + status_offset;
             leds->front_strip.data = led_data + front_offset;
@@ -902,10 +1018,15 @@ void leds_setup(Leds *leds, CfgHwLeds *hw_cfg, const CfgLeds *cfg) {
     leds_configure(leds, cfg);
 
     if (led_data) {
-        if (led_driver_setup(&leds->led_driver, hw_cfg->pin, hw_cfg->pin_config, strip_array)) {
+        if (led_driver_setup(&leds->led_driver, strip_pins, hw_cfg->pin_config, strip_array)) {
             leds->led_data = led_data;
         } else {
             VESC_IF->free(led_data);
+            if (leds->trans_pool.buffer) {
+                VESC_IF->free(leds->trans_pool.buffer);
+                leds->trans_pool.buffer = NULL;
+                leds->trans_pool.size = 0;
+            }
         }
     }
 }
@@ -926,6 +1047,7 @@ void leds_configure(Leds *leds, const CfgLeds *cfg) {
     float current_time = VESC_IF->system_time();
     leds->status_idle_time = current_time;
     leds->status_on_front_idle_time = current_time;
+    leds->update_requested = true;
 }
 
 const LedsRuntimeStatus *leds_get_runtime_status(const Leds *leds) {
@@ -935,11 +1057,53 @@ const LedsRuntimeStatus *leds_get_runtime_status(const Leds *leds) {
 void leds_set_enabled(Leds *leds, bool value) {
     leds->runtime_status.enabled = value;
     leds->runtime_status_overriden.enabled = true;
+    leds->update_requested = true;
 }
 
 void leds_set_headlights_enabled(Leds *leds, bool value) {
     leds->runtime_status.headlights_enabled = value;
     leds->runtime_status_overriden.headlights_enabled = true;
+    leds->update_requested = true;
+}
+
+bool leds_update_due(const Leds *leds, const State *state, FootpadSensorState fs_state) {
+    if (!leds->led_data) {
+        return false;
+    }
+
+    if (VESC_IF->system_time() < leds->last_updated + min_frame_period(leds)) {
+        return false;
+    }
+
+    if (leds->update_requested || VESC_IF->system_time() >= leds->next_update ||
+        led_driver_resend_pending(&leds->led_driver)) {
+        return true;
+    }
+
+    if (state->state != leds->state.state || state->mode != leds->state.mode ||
+        state->sat != leds->state.sat || state->stop_condition != leds->state.stop_condition ||
+        state->charging != leds->state.charging || state->wheelslip != leds->state.wheelslip ||
+        state->darkride != leds->state.darkride || fs_state != leds->fs_state) {
+        return true;
+    }
+
+    // the upright board hysteresis in leds_update()
+    float pitch = rad2deg(VESC_IF->imu_get_pitch());
+    return leds->board_is_upright ? pitch < 50 : pitch > 60;
+}
+
+float leds_next_update(const Leds *leds) {
+    if (!leds->led_data) {
+        return FLT_MAX;
+    }
+
+    // a requested update or a frame to resend is due as soon as the frame
+    // period allows
+    float next_update = leds->next_update;
+    if (leds->update_requested || led_driver_resend_pending(&leds->led_driver)) {
+        next_update = leds->last_updated;
+    }
+    return fmaxf(next_update, leds->last_updated + min_frame_period(leds));
 }
 
 void leds_update(
@@ -950,9 +1114,14 @@ void leds_update(
     }
 
     float current_time = VESC_IF->system_time();
+    float frame_time_max = fmaxf(1.0f / LEDS_REFRESH_RATE, min_frame_period(leds));
+    leds->frame_time = clampf(current_time - leds->last_updated, 0.0f, frame_time_max);
     leds->last_updated = current_time;
+    leds->next_update = current_time + IDLE_UPDATE_PERIOD;
+    leds->update_requested = false;
     RunState old_state = leds->state.state;
     leds->state = *state;
+    leds->fs_state = fs_state;
 
     if (leds->state.state == STATE_STARTUP) {
         return;
@@ -962,15 +1131,17 @@ void leds_update(
         if (leds->on_off_fade == 0.0f) {
             full_animation_reset(leds, current_time);
         }
-        rate_limitf(&leds->on_off_fade, 1.0f, BR_RATE);
+        leds_rate_limit(leds, &leds->on_off_fade, 1.0f, BR_RATE);
     } else {
         if (leds->on_off_fade == 0.0f) {
             return;
         }
-        rate_limitf(&leds->on_off_fade, 0.0f, BR_RATE);
+        leds_rate_limit(leds, &leds->on_off_fade, 0.0f, BR_RATE);
     }
 
     leds->pitch = rad2deg(VESC_IF->imu_get_pitch());
+    leds->speed = motor->speed;
+    leds->duty = motor->duty_cycle.value;
 
     if (fs_state != FS_NONE) {
         leds->status_idle_time = current_time;
@@ -1024,59 +1195,67 @@ void leds_update(
     if (leds->status_idle_blend > 0.0f) {
         status_brightness = fminf(status_brightness, leds->cfg->status_idle.brightness);
     }
-    rate_limitf(&leds->status_strip.brightness, status_brightness, BR_RATE);
+    leds_rate_limit(leds, &leds->status_strip.brightness, status_brightness, BR_RATE);
 
     // front brightness
     if (status_on_front) {
-        rate_limitf(&leds->front_strip.brightness, status_brightness, BR_RATE);
+        leds_rate_limit(leds, &leds->front_strip.brightness, status_brightness, BR_RATE);
     } else {
         if (leds->board_is_upright && leds->cfg->lights_off_when_lifted) {
-            rate_limitf(&leds->front_strip.brightness, 0.0f, BR_RATE);
+            leds_rate_limit(leds, &leds->front_strip.brightness, 0.0f, BR_RATE);
         } else {
-            rate_limitf(&leds->front_strip.brightness, leds->front_bar->brightness, BR_RATE);
+            leds_rate_limit(
+                leds, &leds->front_strip.brightness, leds->front_bar->brightness, BR_RATE
+            );
         }
     }
 
     // rear brightness
     if (leds->board_is_upright && leds->cfg->lights_off_when_lifted) {
-        rate_limitf(&leds->rear_strip.brightness, 0.0f, BR_RATE);
+        leds_rate_limit(leds, &leds->rear_strip.brightness, 0.0f, BR_RATE);
     } else {
-        rate_limitf(&leds->rear_strip.brightness, leds->rear_bar->brightness, BR_RATE);
+        leds_rate_limit(leds, &leds->rear_strip.brightness, leds->rear_bar->brightness, BR_RATE);
     }
 
-    rate_limitf(&leds->status_on_front_blend, status_on_front ? 1.0f : 0.0f, BR_RATE);
+    leds_rate_limit(leds, &leds->status_on_front_blend, status_on_front ? 1.0f : 0.0f, BR_RATE);
 
     if (leds->state.state == STATE_DISABLED) {
         anim_disabled(leds, &leds->front_strip, current_time);
         anim_disabled(leds, &leds->rear_strip, current_time);
         anim_disabled(leds, &leds->status_strip, current_time);
+        request_next_frame(leds);
         led_driver_paint(&leds->led_driver);
         return;
     }
 
+    if (leds->state.state == STATE_RUNNING) {
+        // the status bar and the direction transition follow the ride
+        request_frame(leds, current_time + 1.0f / LEDS_REFRESH_RATE);
+    }
+
     // footpad sensor indicator animation
     if (!leds->cfg->status.show_sensors_while_running && leds->state.state == STATE_RUNNING) {
-        rate_limitf(&leds->left_sensor, 0.0f, FS_RATE);
-        rate_limitf(&leds->right_sensor, 0.0f, FS_RATE);
+        leds_rate_limit(leds, &leds->left_sensor, 0.0f, FS_RATE);
+        leds_rate_limit(leds, &leds->right_sensor, 0.0f, FS_RATE);
     } else {
         if ((leds->state.state != STATE_RUNNING && fs_state & FS_LEFT) || fs_state == FS_LEFT) {
-            rate_limitf(&leds->left_sensor, 1.0f, FS_RATE);
+            leds_rate_limit(leds, &leds->left_sensor, 1.0f, FS_RATE);
             // reset idle blend so that the idle animation doesn't pop back up after a short press
             if (leds->left_sensor >= 1.0f) {
                 leds->status_idle_blend = 0.0f;
             }
         } else {
-            rate_limitf(&leds->left_sensor, 0.0f, FS_RATE);
+            leds_rate_limit(leds, &leds->left_sensor, 0.0f, FS_RATE);
         }
 
         if ((leds->state.state != STATE_RUNNING && fs_state & FS_RIGHT) || fs_state == FS_RIGHT) {
-            rate_limitf(&leds->right_sensor, 1.0f, FS_RATE);
+            leds_rate_limit(leds, &leds->right_sensor, 1.0f, FS_RATE);
             // reset idle blend so that the idle animation doesn't pop back up after a short press
             if (leds->right_sensor >= 1.0f) {
                 leds->status_idle_blend = 0.0f;
             }
         } else {
-            rate_limitf(&leds->right_sensor, 0.0f, FS_RATE);
+            leds_rate_limit(leds, &leds->right_sensor, 0.0f, FS_RATE);
         }
     }
 
@@ -1216,15 +1395,24 @@ void leds_update(
         }
     }
 
+    if (leds->headlights_time <= 0.0f && fabsf(leds->dir_trans.split) >= 1.0f) {
+        transitions_release(leds);
+    } else {
+        request_next_frame(leds);
+    }
+
     if (leds->status_strip.length > 0) {
         float idle_timeout = leds->cfg->status.idle_timeout;
         if (idle_timeout > 0.0f && current_time - leds->status_idle_time > idle_timeout) {
             if (leds->status_idle_blend == 0.0f) {
                 leds->status_animation_start = current_time;
             }
-            rate_limitf(&leds->status_idle_blend, 1.0f, BR_RATE);
+            leds_rate_limit(leds, &leds->status_idle_blend, 1.0f, BR_RATE);
         } else {
-            rate_limitf(&leds->status_idle_blend, 0.0f, BR_RATE);
+            leds_rate_limit(leds, &leds->status_idle_blend, 0.0f, BR_RATE);
+            if (idle_timeout > 0.0f) {
+                request_frame(leds, leds->status_idle_time + idle_timeout);
+            }
         }
 
         status_animate(
@@ -1236,9 +1424,12 @@ void leds_update(
         leds->front_strip.length > 0) {
         if (leds->cfg->lights_off_when_lifted &&
             current_time - leds->status_on_front_idle_time > 3.0f) {
-            rate_limitf(&leds->status_on_front_idle_blend, 1.0f, BR_RATE);
+            leds_rate_limit(leds, &leds->status_on_front_idle_blend, 1.0f, BR_RATE);
         } else {
-            rate_limitf(&leds->status_on_front_idle_blend, 0.0f, BR_RATE);
+            leds_rate_limit(leds, &leds->status_on_front_idle_blend, 0.0f, BR_RATE);
+            if (leds->cfg->lights_off_when_lifted) {
+                request_frame(leds, leds->status_on_front_idle_time + 3.0f);
+            }
         }
 
         status_animate(
@@ -1262,6 +1453,7 @@ void leds_status_confirm(Leds *leds) {
     float current_time = VESC_IF->system_time();
     if (current_time - leds->confirm_animation_start > CONFIRM_ANIMATION_DURATION) {
         leds->confirm_animation_start = current_time;
+        leds->update_requested = true;
     }
 }
 
@@ -1272,4 +1464,12 @@ void leds_destroy(Leds *leds) {
         VESC_IF->free(leds->led_data);
         leds->led_data = NULL;
     }
+
+    if (leds->trans_pool.buffer) {
+        VESC_IF->free(leds->trans_pool.buffer);
+        leds->trans_pool.buffer = NULL;
+        leds->trans_pool.size = 0;
+        leds->trans_pool.used = 0;
+    }
+    transitions_release(leds);
 }
@@ -20,17 +20,29 @@
 #include "conf/datatypes.h"
 #include "footpad_sensor.h"
 #include "led_driver.h"
+#include "led_program.h"
 #include "led_strip.h"
 #include "motor_data.h"
 #include "state.h"
 
+// Refresh rate of the LEDs when the scene is in motion, higher rates are
+// only used by the animations and transitions which benefit from it
 #define LEDS_REFRESH_RATE 30
+#define LEDS_REFRESH_RATE_MAX 100
 
 typedef struct {
     LedTransition transition;
     float split;
 } TransitionState;
 
+// Scratch memory of the transitions, handed out to the strips when a
+// transition starts and released when no transition is running
+typedef struct {
+    uint16_t *buffer;
+    uint16_t size;
+    uint16_t used;
+} TransitionPool;
+
 typedef struct {
     bool enabled;
     bool headlights_enabled;
@@ -44,8 +56,18 @@ typedef struct {
     const CfgLeds *cfg;
 
     float last_updated;
+    // time by which the next frame needs to be rendered, requested by the
+    // animations, and whether a frame was requested by an outside change
+    float next_update;
+    bool update_requested;
+    // time since the previous frame, limited to the regular refresh period
+    // (or the minimum frame period of long strips)
+    float frame_time;
     State state;
+    FootpadSensorState fs_state;
     float pitch;
+    float speed;
+    float duty;
 
     float left_sensor;
     float right_sensor;
@@ -77,6 +99,8 @@ typedef struct {
 
     TransitionState headlights_trans;
     TransitionState dir_trans;
+    TransitionPool trans_pool;
+    LedPrograms programs;
 
     const LedBar *front_bar;
     const LedBar *front_dir_target;
@@ -102,6 +126,13 @@ void leds_set_enabled(Leds *leds, bool value);
 
 void leds_set_headlights_enabled(Leds *leds, bool value);
 
+// Returns whether leds_update() should be called, either because the scene
+// requested a new frame or because its inputs changed.
+bool leds_update_due(const Leds *leds, const State *state, FootpadSensorState fs_state);
+
+// Returns the system time of the next frame requested by the scene.
+float leds_next_update(const Leds *leds);
+
 void leds_update(
     Leds *leds, const State *state, const MotorData *motor, FootpadSensorState fs_state
 );
@@ -0,0 +1,133 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include "p2_quantile.h"
+
+static void sort(float *values, uint8_t count) {
+    for (uint8_t i = 1; i < count; ++i) {
+        float value = values[i];
+        uint8_t j = i;
+        for (; j > 0 && values[j - 1] > value; --j) {
+            values[j] = values[j - 1];
+        }
+        values[j] = value;
+    }
+}
+
+void p2_quantile_init(P2Quantile *q, float p) {
+    q->p = p;
+    p2_quantile_reset(q);
+}
+
+void p2_quantile_reset(P2Quantile *q) {
+    q->count = 0;
+    for (uint8_t i = 0; i < P2_MARKERS; ++i) {
+        q->heights[i] = 0.0f;
+        q->positions[i] = i;
+    }
+
+    q->desired[0] = 0.0f;
+    q->desired[1] = 2.0f * q->p;
+    q->desired[2] = 4.0f * q->p;
+    q->desired[3] = 2.0f + 2.0f * q->p;
+    q->desired[4] = 4.0f;
+}
+
+static float parabolic(const P2Quantile *q, uint8_t i, float d) {
+    const float *n = q->positions;
+    const float *h = q->heights;
+    return h[i] +
+        d / (n[i + 1] - n[i - 1]) *
+        ((n[i] - n[i - 1] + d) * (h[i + 1] - h[i]) / (n[i + 1] - n[i]) +
+         (n[i + 1] - n[i] - d) * (h[i] - h[i - 1]) / (n[i] - n[i - 1]));
+}
+
+static float linear(const P2Quantile *q, uint8_t i, int8_t d) {
+    const float *n = q->positions;
+    const float *h = q->heights;
+    return h[i] + d * (h[i + d] - h[i]) / (n[i + d] - n[i]);
+}
+
+void p2_quantile_update(P2Quantile *q, float value) {
+    // collect the first values as the initial marker heights
+    if (q->count < P2_MARKERS) {
+        q->heights[q->count++] = value;
+        if (q->count == P2_MARKERS) {
+            sort(q->heights, P2_MARKERS);
+        }
+        return;
+    }
+    ++q->count;
+
+    // find the cell the value falls into, extending the extremes if needed
+    uint8_t k;
+    if (value < q->heights[0]) {
+        q->heights[0] = value;
+        k = 0;
+    } else if (value >= q->heights[4]) {
+        q->heights[4] = value;
+        k = 3;
+    } else {
+        k = 0;
+        while (value >= q->heights[k + 1]) {
+            ++k;
+        }
+    }
+
+    for (uint8_t i = k + 1; i < P2_MARKERS; ++i) {
+        q->positions[i] += 1.0f;
+    }
+
+    q->desired[1] += q->p / 2.0f;
+    q->desired[2] += q->p;
+    q->desired[3] += (1.0f + q->p) / 2.0f;
+    q->desired[4] += 1.0f;
+
+    // adjust the inner markers if they're off their desired positions
+    for (uint8_t i = 1; i < P2_MARKERS - 1; ++i) {
+        float diff = q->desired[i] - q->positions[i];
+        if ((diff >= 1.0f && q->positions[i + 1] - q->positions[i] > 1.0f) ||
+            (diff <= -1.0f && q->positions[i - 1] - q->positions[i] < -1.0f)) {
+            int8_t d = diff > 0.0f ? 1 : -1;
+            float height = parabolic(q, i, d);
+            if (q->heights[i - 1] < height && height < q->heights[i + 1]) {
+                q->heights[i] = height;
+            } else {
+                q->heights[i] = linear(q, i, d);
+            }
+            q->positions[i] += d;
+        }
+    }
+}
+
+float p2_quantile_value(const P2Quantile *q) {
+    if (q->count == 0) {
+        return 0.0f;
+    }
+
+    if (q->count < P2_MARKERS) {
+        // not enough values for the markers, pick from the sorted values
+        float values[P2_MARKERS];
+        for (uint8_t i = 0; i < q->count; ++i) {
+            values[i] = q->heights[i];
+        }
+        sort(values, q->count);
+        return values[(uint8_t) (q->p * (q->count - 1) + 0.5f)];
+    }
+
+    return q->heights[2];
+}
@@ -0,0 +1,47 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+
+#define P2_MARKERS 5
+
+// Streaming estimator of a single quantile in constant memory, using the P²
+// algorithm (R. Jain, I. Chlamtac: The P² Algorithm for Dynamic Calculation of
+// Quantiles and Histograms Without Storing Observations, 1985).
+//
+// Five markers track the minimum, the p/2, p, (1+p)/2 quantiles and the
+// maximum. On every value, the marker positions are adjusted towards their
+// desired positions and their heights are interpolated by a piecewise
+// parabolic formula.
+typedef struct {
+    float p;
+    uint32_t count;
+    float heights[P2_MARKERS];
+    float positions[P2_MARKERS];
+    float desired[P2_MARKERS];
+} P2Quantile;
+
+void p2_quantile_init(P2Quantile *q, float p);
+
+void p2_quantile_reset(P2Quantile *q);
+
+void p2_quantile_update(P2Quantile *q, float value);
+
+// Returns the estimate of the quantile, 0 if there are no values yet.
+float p2_quantile_value(const P2Quantile *q);
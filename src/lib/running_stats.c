@@ -0,0 +1,53 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include "running_stats.h"
+
+void running_stats_reset(RunningStats *rs) {
+    rs->count = 0;
+    rs->min = 0.0f;
+    rs->max = 0.0f;
+    rs->mean = 0.0;
+    rs->m2 = 0.0;
+}
+
+void running_stats_update(RunningStats *rs, float value) {
+    if (rs->count == 0) {
+        rs->min = value;
+        rs->max = value;
+    } else if (value < rs->min) {
+        rs->min = value;
+    } else if (value > rs->max) {
+        rs->max = value;
+    }
+
+    ++rs->count;
+    double delta = (double) value - rs->mean;
+    rs->mean += delta / rs->count;
+    rs->m2 += delta * ((double) value - rs->mean);
+}
+
+float running_stats_mean(const RunningStats *rs) {
+    return (float) rs->mean;
+}
+
+float running_stats_variance(const RunningStats *rs) {
+    if (rs->count < 2) {
+        return 0.0f;
+    }
+    return (float) (rs->m2 / rs->count);
+}
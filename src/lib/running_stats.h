@@ -0,0 +1,43 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+
+// Streaming count, minimum, maximum, mean and variance of a value in constant
+// memory, using Welford's algorithm for a numerically stable variance.
+//
+// The mean and m2 are in double: at the control loop rate, the count gets to
+// millions within tens of minutes and delta / count falls below the float
+// resolution of the mean, which would then stop updating.
+typedef struct {
+    uint32_t count;
+    float min;
+    float max;
+    double mean;
+    double m2;  // sum of squared differences from the mean
+} RunningStats;
+
+void running_stats_reset(RunningStats *rs);
+
+void running_stats_update(RunningStats *rs, float value);
+
+float running_stats_mean(const RunningStats *rs);
+
+// Population variance of the values, 0 if there are fewer than two values.
+float running_stats_variance(const RunningStats *rs);
@@ -0,0 +1,89 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include "seq_buffer.h"
+
+#include <string.h>
+
+void seq_buffer_init(SeqBuffer *sb, size_t item_size, size_t item_number, void *buffer) {
+    sb->buffer = buffer;
+    sb->length = item_number;
+    sb->item_size = item_size;
+    sb->head = 0;
+}
+
+size_t seq_buffer_capacity(const SeqBuffer *sb) {
+    return sb->length > 0 ? sb->length - 1 : 0;
+}
+
+void seq_buffer_push(SeqBuffer *sb, const void *item) {
+    // the slot is derived from the sequence number the same way as by the
+    // readers, a separately wrapped index would disagree with seq % length
+    // once the sequence number wraps around (unless length is a power of two)
+    memcpy(sb->buffer + (sb->head % sb->length) * sb->item_size, item, sb->item_size);
+
+    // publish the item only after it's been fully written
+    __atomic_store_n(&sb->head, sb->head + 1, __ATOMIC_RELEASE);
+}
+
+uint32_t seq_buffer_head(const SeqBuffer *sb) {
+    return __atomic_load_n(&sb->head, __ATOMIC_ACQUIRE);
+}
+
+// The slot of the item seq gets overwritten by the item seq + length, which
+// can already be in progress when the head is at seq + length, therefore an
+// item is only valid when it's less than length - 1 items behind the head.
+static inline bool is_readable(const SeqBuffer *sb, uint32_t head, uint32_t seq) {
+    return head - seq - 1 < seq_buffer_capacity(sb);
+}
+
+bool seq_buffer_read(const SeqBuffer *sb, uint32_t seq, void *item) {
+    if (!is_readable(sb, seq_buffer_head(sb), seq)) {
+        return false;
+    }
+
+    memcpy(item, sb->buffer + (seq % sb->length) * sb->item_size, sb->item_size);
+
+    // check the producer didn't start overwriting the item while we were
+    // copying it (the acquire load can't be reordered before the copy)
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return is_readable(sb, seq_buffer_head(sb), seq);
+}
+
+bool seq_buffer_is_readable(const SeqBuffer *sb, uint32_t seq) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return is_readable(sb, seq_buffer_head(sb), seq);
+}
+
+size_t seq_buffer_span(const SeqBuffer *sb, uint32_t seq, size_t count, const void **items) {
+    uint32_t head = seq_buffer_head(sb);
+    if (!is_readable(sb, head, seq)) {
+        return 0;
+    }
+
+    size_t index = seq % sb->length;
+    size_t n = head - seq;
+    if (n > count) {
+        n = count;
+    }
+    if (n > sb->length - index) {
+        n = sb->length - index;
+    }
+
+    *items = sb->buffer + index * sb->item_size;
+    return n;
+}
@@ -0,0 +1,90 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A lock-free ring buffer for a single producer and a single consumer.
+//
+// Items are addressed by a sequence number, which increases by one with every
+// pushed item (wrapping around on overflow). The producer never waits for the
+// consumer, it overwrites the oldest items. Instead of a shared tail, the
+// consumer keeps its own read cursor (a sequence number) and detects items
+// which were overwritten before or while reading them.
+//
+// Only the head sequence number is shared between the threads, it's published
+// by the producer after the item has been written.
+
+typedef struct {
+    uint8_t *buffer;
+    size_t length;
+    size_t item_size;
+    uint32_t head;  // sequence number of the next item to be written, atomic
+} SeqBuffer;
+
+/**
+ * Initializes the buffer. Not thread-safe, needs to be called while neither
+ * the producer nor the consumer are accessing the buffer. One of the
+ * item_number slots is reserved for the item being written, so the buffer can
+ * hold item_number - 1 readable items.
+ */
+void seq_buffer_init(SeqBuffer *sb, size_t item_size, size_t item_number, void *buffer);
+
+/**
+ * Number of items that can be read from the buffer when it's full.
+ */
+size_t seq_buffer_capacity(const SeqBuffer *sb);
+
+/**
+ * Pushes an item into the buffer, overwriting the oldest item when it's full.
+ * Must only be called from the producer thread.
+ */
+void seq_buffer_push(SeqBuffer *sb, const void *item);
+
+/**
+ * Returns the sequence number of the next item to be pushed.
+ */
+uint32_t seq_buffer_head(const SeqBuffer *sb);
+
+/**
+ * Reads an item with sequence number seq. Returns false and the contents of
+ * item are undefined if the item hasn't been written yet, or if it has been
+ * overwritten before or during the read.
+ */
+bool seq_buffer_read(const SeqBuffer *sb, uint32_t seq, void *item);
+
+/**
+ * Returns whether the item seq has been written and not yet overwritten (not
+ * even partially).
+ */
+bool seq_buffer_is_readable(const SeqBuffer *sb, uint32_t seq);
+
+/**
+ * Gets a span of up to count consecutive items starting at seq directly in the
+ * buffer memory, without copying. The span ends at the end of the buffer
+ * memory, the rest needs to be fetched by another call.
+ *
+ * Sets items to point to the first item and returns the number of items in the
+ * span, 0 if the item seq is not readable. As the producer can overwrite the
+ * items at any time, after the items have been processed the caller needs to
+ * check the first item (the oldest one) is still readable using
+ * seq_buffer_is_readable(). If it is, the whole span was intact.
+ */
+size_t seq_buffer_span(const SeqBuffer *sb, uint32_t seq, size_t count, const void **items);
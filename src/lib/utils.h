@@ -20,6 +20,7 @@
 #include "vesc_c_if.h"
 
 #include <math.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define ERPM_MOVING_THRESHOLD 10.0f
@@ -69,15 +70,16 @@
 
 #endif
 
-// Declaration for the SEMD_APP_DATA macro, definition needs to be in main.c.
+// Declarations for the SEND_APP_DATA macro, definitions need to be in main.c.
 void fatal_error_terminate();
+void send_app_data(unsigned char *buffer, unsigned int len);
 
 #define SEND_BUF_MAX_SIZE 511
 
 /**
- * DRY macro to check the buffer didn't overflow and send the app data.
+ * DRY macro to check the buffer didn't overflow.
  */
-#define SEND_APP_DATA(buffer, buf_size, ind)                                                       \
+#define CHECK_APP_DATA_OVERFLOW(buffer, buf_size, ind)                                             \
     do {                                                                                           \
         _Static_assert(                                                                            \
             buf_size <= SEND_BUF_MAX_SIZE, "Data to send too long, won't fit into send buffer."    \
@@ -92,6 +94,26 @@ void fatal_error_terminate();
             /* terminate the main thread, the memory has just been corrupted by buffer overflow */ \
             fatal_error_terminate();                                                               \
         }                                                                                          \
+    } while (0)
+
+/**
+ * DRY macro to check the buffer didn't overflow and send the app data. Only to
+ * be used from the command handling thread, as the data is collected into the
+ * reply instead of being sent while a BATCH command is being processed.
+ */
+#define SEND_APP_DATA(buffer, buf_size, ind)                                                       \
+    do {                                                                                           \
+        CHECK_APP_DATA_OVERFLOW(buffer, buf_size, ind);                                            \
+        send_app_data(buffer, ind);                                                                \
+    } while (0)
+
+/**
+ * Same as SEND_APP_DATA, but bypasses the BATCH reply collection, for sending
+ * from other threads than the command handling thread.
+ */
+#define SEND_APP_DATA_DIRECT(buffer, buf_size, ind)                                                \
+    do {                                                                                           \
+        CHECK_APP_DATA_OVERFLOW(buffer, buf_size, ind);                                            \
         VESC_IF->send_app_data(buffer, ind);                                                       \
     } while (0)
 
@@ -130,6 +152,11 @@ uint32_t rnd(uint32_t seed);
 
 float clampf(float value, float min, float max);
 
+/**
+ * CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xFFFF).
+ */
+uint16_t crc16(const uint8_t *data, size_t len);
+
 /**
  * Rate-limits @p value towards @p target by an amount of maximum value of @p step.
  *
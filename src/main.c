@@ -39,6 +39,7 @@
 #include "pid.h"
 #include "remote.h"
 #include "rt_data.h"
+#include "rt_frame.h"
 #include "state.h"
 #include "time.h"
 #include "torque_tilt.h"
@@ -58,6 +59,8 @@
 HEADER
 
 #define MAIN_THREAD_FREQ 500
+// Rate of the housekeeping in the aux thread, the LEDs have their own schedule
+#define AUX_THD_RATE 30
 
 typedef enum {
     BEEP_NONE = 0,
@@ -96,6 +99,9 @@ static const FootpadSensorState headlights_off_konami_sequence[] = {
 
 static void flywheel_stop(Data *d);
 static void cmd_flywheel_toggle(Data *d, unsigned char *cfg, int len);
+static void push_realtime_data(Data *d);
+static void handle_command(unsigned char *buffer, unsigned int len);
+static void process_command_queue(Data *d);
 
 const VESC_PIN beeper_pin = VESC_PIN_PPM;
 
@@ -176,25 +182,95 @@ static void imu_freq_update_reconfigure(float frequency) {
     data_recorder_set_sample_rate(&d->data_record, frequency);
 }
 
+// Components which need to be reconfigured after a change of the config
+// fields they read in their *_configure(). Config fields only read directly by
+// the control loop don't need any reconfiguration.
+enum {
+    RECONF_BALANCE_FILTER = 1 << 0,  // mahony_kp, mahony_kp_roll
+    RECONF_MOTOR_DATA = 1 << 1,  // atr_filter
+    RECONF_TORQUE_TILT = 1 << 2,  // torque_tilt.*
+    RECONF_ATR = 1 << 3,  // atr.*, atr_speed_boost
+    RECONF_BRAKE_TILT = 1 << 4,  // atr.*, braketilt_*
+    RECONF_TURN_TILT = 1 << 5,  // turn_tilt.*, turntilt_erpm_boost*
+    RECONF_REMOTE = 1 << 6,  // remote.*
+    RECONF_MOTOR_CONTROL = 1 << 7,  // brake_current, startup_click_current, parking_brake_mode
+    RECONF_HAPTIC_FEEDBACK = 1 << 8,  // haptic.*, tiltback_duty
+    RECONF_ALERT_TRACKER = 1 << 9,  // persistent_fatal_error
+    RECONF_LEDS = 1 << 10,  // leds.*
+    // startup_dirtylandings_enabled, tiltback_variable, tiltback_variable_max
+    RECONF_DERIVED = 1 << 11,
+    RECONF_ALL = 0xFFF,
+};
+
+static void reconfigure_components(Data *d, uint32_t components) {
+    const RefloatConfig *cfg = &d->float_conf;
+    float main_freq = d->main_freq_tracker.filter_frequency;
+
+    if (components & RECONF_BALANCE_FILTER) {
+        balance_filter_configure(&d->balance_filter, cfg);
+    }
+
+    // the components dependent on the loop frequencies are reconfigured in
+    // full on frequency changes, see *_freq_update_reconfigure()
+    if (components & RECONF_MOTOR_DATA) {
+        motor_data_configure(&d->motor, cfg->atr_filter, main_freq);
+    }
+    if (components & RECONF_TORQUE_TILT) {
+        torque_tilt_configure(&d->torque_tilt, cfg, main_freq);
+    }
+    if (components & RECONF_ATR) {
+        atr_configure(&d->atr, cfg, main_freq);
+    }
+    if (components & RECONF_BRAKE_TILT) {
+        brake_tilt_configure(&d->brake_tilt, cfg, main_freq);
+    }
+    if (components & RECONF_TURN_TILT) {
+        turn_tilt_configure(&d->turn_tilt, cfg, main_freq);
+    }
+    if (components & RECONF_REMOTE) {
+        remote_configure(&d->remote, cfg, main_freq);
+    }
+    if (components & RECONF_MOTOR_CONTROL) {
+        motor_control_configure(&d->motor_control, cfg, d->imu_freq_tracker.filter_frequency);
+    }
+
+    if (components & RECONF_HAPTIC_FEEDBACK) {
+        haptic_feedback_configure(&d->haptic_feedback, cfg);
+    }
+    if (components & RECONF_ALERT_TRACKER) {
+        alert_tracker_configure(&d->alert_tracker, cfg);
+    }
+    if (components & RECONF_LEDS) {
+        leds_configure(&d->leds, &cfg->leds);
+    }
+
+    if (components & RECONF_DERIVED) {
+        d->startup_pitch_trickmargin = cfg->startup_dirtylandings_enabled ? 10 : 0;
+        d->tiltback_variable = cfg->tiltback_variable / 1000 * sign(cfg->tiltback_variable_max);
+        // TODO handle division by zero
+        d->tiltback_variable_max_erpm = fabsf(cfg->tiltback_variable_max / d->tiltback_variable);
+    }
+
+    time_refresh_idle(&d->time);
+}
+
 static void reconfigure(Data *d) {
     balance_filter_configure(&d->balance_filter, &d->float_conf);
 
     main_freq_update_reconfigure(d->main_freq_tracker.filter_frequency);
     imu_freq_update_reconfigure(d->imu_freq_tracker.filter_frequency);
 
-    haptic_feedback_configure(&d->haptic_feedback, &d->float_conf);
-    alert_tracker_configure(&d->alert_tracker, &d->float_conf);
-
-    leds_configure(&d->leds, &d->float_conf.leds);
-
-    d->startup_pitch_trickmargin = d->float_conf.startup_dirtylandings_enabled ? 10 : 0;
-    d->tiltback_variable =
-        d->float_conf.tiltback_variable / 1000 * sign(d->float_conf.tiltback_variable_max);
-    // TODO handle division by zero
-    d->tiltback_variable_max_erpm =
-        fabsf(d->float_conf.tiltback_variable_max / d->tiltback_variable);
+    reconfigure_components(
+        d,
+        RECONF_HAPTIC_FEEDBACK | RECONF_ALERT_TRACKER | RECONF_LEDS | RECONF_DERIVED
+    );
+}
 
-    time_refresh_idle(&d->time);
+// Marks components to be reconfigured after a runtime tune command. The
+// reconfiguration is done by the aux thread after processing the queued
+// commands, once for all of them.
+static void request_reconfigure(Data *d, uint32_t components) {
+    d->reconfigure_pending |= components;
 }
 
 static void configure(Data *d) {
@@ -218,6 +294,9 @@ static void configure(Data *d) {
 
     d->beeper_enabled = d->float_conf.is_beeper_enabled;
 
+    // the tune has been (re)loaded from the config
+    d->tune_profiles.active = -1;
+
     reconfigure(d);
 
     lcm_configure(&d->lcm, &d->leds);
@@ -780,6 +859,9 @@ static void refloat_thd(void *arg) {
 
         time_update(&d->time, d->state.state);
 
+        // in between the control loop iterations, for the switch to be atomic
+        tune_profiles_apply_pending(&d->tune_profiles, &d->float_conf);
+
         beeper_update(d);
 
         charging_timeout(&d->charging, &d->state);
@@ -831,6 +913,7 @@ static void refloat_thd(void *arg) {
 
         motor_data_evaluate_alerts(&d->motor, &d->alert_tracker, &d->time);
         alert_tracker_finalize(&d->alert_tracker, &d->time);
+        ride_stats_update(&d->ride_stats, &d->state, &d->motor, dt);
         if (alert_tracker_is_alert_active(&d->alert_tracker, ALERT_FW_FAULT)) {
             d->beep_reason = BEEP_FW_FAULT;
         }
@@ -1066,9 +1149,31 @@ static void refloat_thd(void *arg) {
 #define SERIALIZED_CONFIG_LENGTH 320
 #endif
 
+#define CFG_WORDS ((SERIALIZED_CONFIG_LENGTH - 1) / 4 + 1)
+
+// The EEPROM word after the config holds a CRC of the config words, to detect
+// an incomplete write. Its upper half is a magic number, to tell it apart from
+// an EEPROM written by older versions without the CRC.
+#define CFG_CRC_MAGIC 0x5246u
+
+static uint32_t cfg_crc_word(const uint32_t *buffer) {
+    return CFG_CRC_MAGIC << 16 | crc16((const uint8_t *) buffer, CFG_WORDS * 4);
+}
+
+// Replaces the image of the config as stored in the EEPROM, takes ownership of
+// the buffer. If NULL, the next write writes all words.
+static void cfg_eeprom_image_set(Data *d, uint32_t *buffer, uint32_t crc) {
+    if (d->cfg_eeprom_image) {
+        VESC_IF->free(d->cfg_eeprom_image);
+    }
+    d->cfg_eeprom_image = buffer;
+    d->cfg_eeprom_crc = crc;
+}
+
+// Only writes the words which differ from the image of the last read or
+// written config, followed by the CRC word.
 static void write_cfg_to_eeprom(Data *d) {
-    const size_t words = (SERIALIZED_CONFIG_LENGTH - 1) / 4 + 1;
-    const size_t bufsize = words * 4;
+    const size_t bufsize = CFG_WORDS * 4;
     uint32_t *buffer = VESC_IF->malloc(bufsize);
     if (!buffer) {
         log_error("Failed to write config: Out of memory.");
@@ -1082,24 +1187,80 @@ static void write_cfg_to_eeprom(Data *d) {
         fatal_error_terminate();
     }
 
+    systime_t start = vesc_system_time_ticks();
+    const uint32_t *image = d->cfg_eeprom_image;
+    uint32_t crc = cfg_crc_word(buffer);
+    uint32_t changed_words = 0;
     bool write_ok = true;
-    for (uint32_t i = 0; i < words; ++i) {
-        eeprom_var v;
+    eeprom_var v;
+    for (uint32_t i = 0; i < CFG_WORDS; ++i) {
+        if (image && image[i] == buffer[i]) {
+            continue;
+        }
+
         v.as_u32 = buffer[i];
         if (!VESC_IF->store_eeprom_var(&v, i)) {
             write_ok = false;
             break;
         }
+        ++changed_words;
     }
 
-    VESC_IF->free(buffer);
+    if (write_ok && crc != d->cfg_eeprom_crc) {
+        v.as_u32 = crc;
+        write_ok = VESC_IF->store_eeprom_var(&v, CFG_WORDS);
+    }
 
     if (write_ok) {
-        log_msg("Config written: %uB", written_bytes);
+        uint32_t elapsed_ms = (vesc_system_time_ticks() - start) * 1000 / SYSTEM_TICK_RATE_HZ;
+        log_msg(
+            "Config written: %uB, %uB changed in %ums", written_bytes, changed_words * 4, elapsed_ms
+        );
+        cfg_eeprom_image_set(d, buffer, crc);
         beep_alert(d, 1, 0);
         leds_status_confirm(&d->leds);
     } else {
         log_error("Failed to write config.");
+        // the EEPROM content is unknown, write everything next time
+        VESC_IF->free(buffer);
+        cfg_eeprom_image_set(d, NULL, 0);
+    }
+}
+
+static void aux_tick(Data *d, time_t *motor_config_refresh_timer) {
+    bool running = d->state.state == STATE_RUNNING;
+
+    frequency_tracker_check(
+        &d->main_freq_tracker, running, &d->time, &main_freq_update_reconfigure
+    );
+    frequency_tracker_check(&d->imu_freq_tracker, running, &d->time, &imu_freq_update_reconfigure);
+
+    push_realtime_data(d);
+
+    process_command_queue(d);
+    if (tune_profiles_take_applied(&d->tune_profiles)) {
+        request_reconfigure(
+            d,
+            RECONF_BALANCE_FILTER | RECONF_MOTOR_DATA | RECONF_TORQUE_TILT | RECONF_ATR |
+                RECONF_BRAKE_TILT | RECONF_TURN_TILT | RECONF_DERIVED
+        );
+    }
+    if (d->reconfigure_pending) {
+        reconfigure_components(d, d->reconfigure_pending);
+        d->reconfigure_pending = 0;
+    }
+
+    // store odometer if we've gone more than 200m
+    if (!running && VESC_IF->mc_get_odometer() > d->odometer + 200) {
+        VESC_IF->store_backup_data();
+        d->odometer = VESC_IF->mc_get_odometer();
+    }
+
+    if (timer_older(&d->time, *motor_config_refresh_timer, 0.5)) {
+        motor_data_refresh_motor_config(
+            &d->motor, d->float_conf.tiltback_lv, d->float_conf.tiltback_hv
+        );
+        timer_refresh(&d->time, motor_config_refresh_timer);
     }
 }
 
@@ -1107,43 +1268,37 @@ static void aux_thd(void *arg) {
     Data *d = (Data *) arg;
 
     if (VESC_IF->thread_set_priority) {
-        VESC_IF->thread_set_priority(-1);
+        VESC_IF->thread_set_priority(LED_DRIVER_THREAD_PRIORITY);
     }
 
     time_t motor_config_refresh_timer = 0;
+    float next_aux_tick = VESC_IF->system_time();
 
     while (!VESC_IF->should_terminate()) {
-        bool running = d->state.state == STATE_RUNNING;
-
-        frequency_tracker_check(
-            &d->main_freq_tracker, running, &d->time, &main_freq_update_reconfigure
-        );
-        frequency_tracker_check(
-            &d->imu_freq_tracker, running, &d->time, &imu_freq_update_reconfigure
-        );
-
-        leds_update(&d->leds, &d->state, &d->motor, d->footpad.state);
-
-        // store odometer if we've gone more than 200m
-        if (!running && VESC_IF->mc_get_odometer() > d->odometer + 200) {
-            VESC_IF->store_backup_data();
-            d->odometer = VESC_IF->mc_get_odometer();
+        // the LEDs are rendered on their own schedule, the rest runs at AUX_THD_RATE
+        if (leds_update_due(&d->leds, &d->state, d->footpad.state)) {
+            leds_update(&d->leds, &d->state, &d->motor, d->footpad.state);
         }
 
-        if (timer_older(&d->time, motor_config_refresh_timer, 0.5)) {
-            motor_data_refresh_motor_config(
-                &d->motor, d->float_conf.tiltback_lv, d->float_conf.tiltback_hv
-            );
-            timer_refresh(&d->time, &motor_config_refresh_timer);
+        float now = VESC_IF->system_time();
+        if (now >= next_aux_tick) {
+            // don't try to catch up on ticks missed because of a long stall
+            next_aux_tick = fmaxf(next_aux_tick + 1.0f / AUX_THD_RATE, now);
+            aux_tick(d, &motor_config_refresh_timer);
         }
 
-        VESC_IF->sleep_us(1e6 / LEDS_REFRESH_RATE);
+        now = VESC_IF->system_time();
+        float next = fminf(leds_next_update(&d->leds), next_aux_tick);
+        VESC_IF->sleep_us(clampf(next - now, 0.001f, 1.0f / AUX_THD_RATE) * 1e6f);
     }
 }
 
-static void read_cfg_from_eeprom(Data *d) {
-    uint32_t words = (SERIALIZED_CONFIG_LENGTH - 1) / 4 + 1;
-    uint32_t *buffer = VESC_IF->malloc(words * sizeof(uint32_t));
+// Reads the config from the EEPROM into float_conf. The EEPROM image is owned
+// by the aux thread, it's only replaced if update_image is set, which must
+// only be done in the aux thread (or before it's started). A read without
+// updating the image leaves it valid, as the EEPROM content is unchanged.
+static void read_cfg_from_eeprom(Data *d, bool update_image) {
+    uint32_t *buffer = VESC_IF->malloc(CFG_WORDS * sizeof(uint32_t));
     if (!buffer) {
         log_error("Failed to read config: Out of memory.");
         return;
@@ -1151,7 +1306,7 @@ static void read_cfg_from_eeprom(Data *d) {
 
     eeprom_var v;
     bool read_ok = true;
-    for (uint32_t i = 0; i < words; ++i) {
+    for (uint32_t i = 0; i < CFG_WORDS; ++i) {
         if (!VESC_IF->read_eeprom_var(&v, i)) {
             read_ok = false;
             break;
@@ -1159,23 +1314,43 @@ static void read_cfg_from_eeprom(Data *d) {
         buffer[i] = v.as_u32;
     }
 
+    // a missing or unmarked CRC word means the config was written by an older
+    // version, it's still accepted and the CRC is added on the next write
+    uint32_t crc = 0;
+    if (read_ok && VESC_IF->read_eeprom_var(&v, CFG_WORDS) && v.as_u32 >> 16 == CFG_CRC_MAGIC) {
+        crc = v.as_u32;
+    }
+
     if (read_ok) {
-        if (!confparser_deserialize_refloatconfig((uint8_t *) buffer, &d->float_conf)) {
+        if (crc != 0 && crc != cfg_crc_word(buffer)) {
+            log_error("Config CRC mismatch (incomplete write?), using defaults.");
+            confparser_set_defaults_refloatconfig(&d->float_conf);
+        } else if (!confparser_deserialize_refloatconfig((uint8_t *) buffer, &d->float_conf)) {
             log_error("Failed to deserialize config, using defaults.");
             confparser_set_defaults_refloatconfig(&d->float_conf);
         }
+
+        if (update_image) {
+            cfg_eeprom_image_set(d, buffer, crc);
+        } else {
+            VESC_IF->free(buffer);
+        }
     } else {
         log_error("Failed to read config, using defaults.");
         confparser_set_defaults_refloatconfig(&d->float_conf);
+        VESC_IF->free(buffer);
+        if (update_image) {
+            cfg_eeprom_image_set(d, NULL, 0);
+        }
     }
-
-    VESC_IF->free(buffer);
 }
 
 static void data_init(Data *d) {
     memset(d, 0, sizeof(Data));
 
-    read_cfg_from_eeprom(d);
+    read_cfg_from_eeprom(d, true);
+    // the profiles are stored after the config and its CRC word
+    tune_profiles_init(&d->tune_profiles, CFG_WORDS + 1);
 
     time_init(&d->time);
 
@@ -1209,12 +1384,19 @@ static void data_init(Data *d) {
     reverse_stop_init(&d->reverse_stop);
 
     leds_init(&d->leds);
+    // the LED programs are stored after the tune profiles
+    led_programs_init(&d->leds.programs, tune_profiles_eeprom_end(&d->tune_profiles));
     leds_setup(&d->leds, &d->float_conf.hardware.leds, &d->float_conf.leds);
     lcm_init(&d->lcm, &d->float_conf.hardware.leds);
     charging_init(&d->charging);
     bms_init(&d->bms);
 
-    data_recorder_init(&d->data_record, imu_sample_rate);
+    ride_stats_init(&d->ride_stats);
+    command_queue_init(&d->command_queue);
+
+    data_recorder_init(
+        &d->data_record, imu_sample_rate, d->float_conf.hardware.data_record_buffer_size
+    );
 
     konami_init(&d->flywheel_konami, flywheel_konami_sequence, sizeof(flywheel_konami_sequence));
     konami_init(
@@ -1263,11 +1445,24 @@ enum {
     COMMAND_REALTIME_DATA_INTERNAL = 31,
     COMMAND_REALTIME_DATA_INTERNAL_IDS = 32,
     COMMAND_REALTIME_DATA = 33,
+    COMMAND_REALTIME_DATA_SUBSCRIBE = 34,
     COMMAND_ALERTS_LIST = 35,
     COMMAND_ALERTS_CONTROL = 36,
+    COMMAND_RIDE_STATS = 37,
+    COMMAND_BATCH = 38,
+    COMMAND_QUEUED_COMPLETED = 39,
+    COMMAND_TUNE_PROFILES = 40,
     COMMAND_DATA_RECORD = 41,
+    COMMAND_LEDS_STATS = 46,
+    COMMAND_LED_PROGRAMS = 47,
 
     // commands above 200 are unstable and can change protocol at any time
+
+    // not app commands, queued internally without a QUEUED_COMPLETED message:
+    // a realtime data subscription change, see cmd_realtime_data_subscribe()
+    COMMAND_INTERNAL_RT_SUBSCRIBE = 254,
+    // the config write from VESC Tool queued by set_cfg()
+    COMMAND_INTERNAL_SET_CFG = 255,
 } Commands;
 
 static void send_realtime_data(Data *d) {
@@ -1416,7 +1611,7 @@ static void cmd_print_info(Data *d) {
 static void cmd_lock(Data *d, unsigned char *cfg) {
     if (d->state.state != STATE_RUNNING) {
         // restore config before locking to avoid accidentally writing temporary changes
-        read_cfg_from_eeprom(d);
+        read_cfg_from_eeprom(d, true);
         d->float_conf.disabled = cfg[0];
         state_set_disabled(&d->state, cfg[0]);
         write_cfg_to_eeprom(d);
@@ -1450,7 +1645,7 @@ static void cmd_handtest(Data *d, unsigned char *cfg) {
         d->float_conf.fault_delay_pitch = 50;
         d->float_conf.fault_delay_roll = 50;
     } else {
-        read_cfg_from_eeprom(d);
+        read_cfg_from_eeprom(d, true);
         configure(d);
     }
 }
@@ -1618,7 +1813,10 @@ static void cmd_runtime_tune(Data *d, unsigned char *cfg, int len) {
         }
     }
 
-    reconfigure(d);
+    request_reconfigure(
+        d,
+        RECONF_BALANCE_FILTER | RECONF_TORQUE_TILT | RECONF_ATR | RECONF_BRAKE_TILT
+    );
 }
 
 static void cmd_tune_defaults(Data *d) {
@@ -1673,7 +1871,11 @@ static void cmd_tune_defaults(Data *d) {
     d->float_conf.startup_simplestart_enabled = CFG_DFLT_SIMPLESTART_ENABLED;
     d->float_conf.startup_dirtylandings_enabled = CFG_DFLT_DIRTYLANDINGS_ENABLED;
 
-    reconfigure(d);
+    request_reconfigure(
+        d,
+        RECONF_BALANCE_FILTER | RECONF_MOTOR_DATA | RECONF_TORQUE_TILT | RECONF_ATR |
+            RECONF_BRAKE_TILT | RECONF_TURN_TILT | RECONF_MOTOR_CONTROL | RECONF_DERIVED
+    );
 }
 
 /**
@@ -1695,6 +1897,7 @@ static void cmd_runtime_tune_tilt(Data *d, unsigned char *cfg, int len) {
         d->float_conf.tiltback_speed = (float) cfg[5];
     }
 
+    request_reconfigure(d, RECONF_HAPTIC_FEEDBACK);
     beep_alert(d, 3, 0);
 }
 
@@ -1774,7 +1977,7 @@ static void cmd_runtime_tune_other(Data *d, unsigned char *cfg, int len) {
         d->float_conf.parking_brake_mode = pbmode;
     }
 
-    reconfigure(d);
+    request_reconfigure(d, RECONF_MOTOR_CONTROL | RECONF_DERIVED);
 }
 
 void cmd_remote(Data *d, uint8_t *buf, int len) {
@@ -1901,7 +2104,8 @@ static void cmd_flywheel_toggle(Data *d, unsigned char *cfg, int len) {
 void flywheel_stop(Data *d) {
     beep_on(d, 1);
     d->state.mode = MODE_NORMAL;
-    read_cfg_from_eeprom(d);
+    // called from the main thread too, which must not touch the EEPROM image
+    read_cfg_from_eeprom(d, false);
     configure(d);
 }
 
@@ -2001,69 +2205,274 @@ static void cmd_realtime_data_internal(Data *d) {
     SEND_APP_DATA(buffer, bufsize, ind);
 }
 
-static void add_rt_item(
-    uint8_t *buffer, int32_t *ind, uint32_t mask, uint32_t item_bit, float value, bool use_float32
-) {
-    if (!(mask & item_bit)) {
-        return;
-    }
+// Realtime data items of REALTIME_DATA. The value is the position of the bit
+// in the masks (mask2 bits offset by 32), which is also the serialization order.
+typedef enum {
+    RT_ITEM_EXTRA_FLAGS = 0,
+    RT_ITEM_STATE_FLAGS = 1,
+    // spare slots
+    RT_ITEM_SPEED = 6,
+    RT_ITEM_ERPM = 7,
+    RT_ITEM_CURRENT = 8,
+    RT_ITEM_DIR_CURRENT = 9,
+    RT_ITEM_FILT_CURRENT = 10,
+    RT_ITEM_DUTY_CYCLE = 11,
+    RT_ITEM_BATTERY_VOLTAGE = 12,
+    RT_ITEM_BATTERY_CURRENT = 13,
+    RT_ITEM_BATTERY_SOC = 14,
+    RT_ITEM_MOSFET_TEMP = 15,
+    RT_ITEM_MOTOR_TEMP = 16,
+    RT_ITEM_PITCH = 17,
+    RT_ITEM_BALANCE_PITCH = 18,
+    RT_ITEM_ROLL = 19,
+    RT_ITEM_ADC_LEFT = 20,
+    RT_ITEM_ADC_RIGHT = 21,
+    RT_ITEM_REMOTE_INPUT = 22,
+    RT_ITEM_SETPOINT = 23,
+    RT_ITEM_ATR_SETPOINT = 24,
+    RT_ITEM_BRAKE_TILT_SETPOINT = 25,
+    RT_ITEM_TORQUE_TILT_SETPOINT = 26,
+    RT_ITEM_TURN_TILT_SETPOINT = 27,
+    RT_ITEM_REMOTE_SETPOINT = 28,
+    RT_ITEM_BALANCE_CURRENT = 29,
+    RT_ITEM_LOOP_FREQUENCY = 30,
+
+    RT_ITEM_ODOMETER = 32 + 0,
+    RT_ITEM_DISTANCE_ABS = 32 + 1,
+    RT_ITEM_CHARGING_VOLTAGE = 32 + 2,
+    RT_ITEM_CHARGING_CURRENT = 32 + 3,
+    RT_ITEM_AMP_HOURS = 32 + 4,
+    RT_ITEM_AMP_HOURS_CHARGED = 32 + 5,
+    RT_ITEM_WATT_HOURS = 32 + 6,
+    RT_ITEM_WATT_HOURS_CHARGED = 32 + 7,
+    RT_ITEM_MOTOR_ID = 32 + 8,  // The FOC direct axis motor current
+    RT_ITEM_GNSS_LAT = 32 + 9,
+    RT_ITEM_GNSS_LON = 32 + 10,
+    RT_ITEM_GNSS_ALTITUDE = 32 + 11,
+    RT_ITEM_GNSS_SPEED = 32 + 12,
+    RT_ITEM_GNSS_ACCURACY = 32 + 13,
+    RT_ITEM_GNSS_LAST_UPDATE = 32 + 14,
+} RtItemIndex;
+
+_Static_assert(sizeof(Data) <= UINT16_MAX, "Data too large for 16-bit realtime item offsets.");
 
-    if (use_float32) {
-        buffer_append_float32_auto(buffer, value, ind);
-    } else {
-        buffer_append_float16_auto(buffer, value, ind);
-    }
+typedef enum {
+    RT_TYPE_NONE = 0,  // unused mask bit
+    RT_TYPE_FIELD,  // a float field in Data
+    RT_TYPE_GETTER,  // a float returned by a getter
+    RT_TYPE_RAW,  // not a float, written by a writer, always sent in delta frames
+} RtItemType;
+
+typedef struct {
+    RtItemType type;
+    uint16_t offset;  // offset of the field in Data for RT_TYPE_FIELD
+    float quantum;  // minimum change of the value to be sent in a delta frame
+    float (*get)(Data *d);
+    void (*write)(Data *d, uint8_t *buffer, int32_t *ind);
+} RtItem;
+
+static void rt_write_extra_flags(Data *d, uint8_t *buffer, int32_t *ind) {
+    buffer[(*ind)++] = encode_extra_flags(&d->data_record);
 }
 
-enum {
-    RT_MASK1_EXTRA_FLAGS = 1 << 0,
-    RT_MASK1_STATE_FLAGS = 1 << 1,
-    // spare slots
-    RT_MASK1_SPEED = 1 << 6,
-    RT_MASK1_ERPM = 1 << 7,
-    RT_MASK1_CURRENT = 1 << 8,
-    RT_MASK1_DIR_CURRENT = 1 << 9,
-    RT_MASK1_FILT_CURRENT = 1 << 10,
-    RT_MASK1_DUTY_CYCLE = 1 << 11,
-    RT_MASK1_BATTERY_VOLTAGE = 1 << 12,
-    RT_MASK1_BATTERY_CURRENT = 1 << 13,
-    RT_MASK1_BATTERY_SOC = 1 << 14,
-    RT_MASK1_MOSFET_TEMP = 1 << 15,
-    RT_MASK1_MOTOR_TEMP = 1 << 16,
-    RT_MASK1_PITCH = 1 << 17,
-    RT_MASK1_BALANCE_PITCH = 1 << 18,
-    RT_MASK1_ROLL = 1 << 19,
-    RT_MASK1_ADC_LEFT = 1 << 20,
-    RT_MASK1_ADC_RIGHT = 1 << 21,
-    RT_MASK1_REMOTE_INPUT = 1 << 22,
-    RT_MASK1_SETPOINT = 1 << 23,
-    RT_MASK1_ATR_SETPOINT = 1 << 24,
-    RT_MASK1_BRAKE_TILT_SETPOINT = 1 << 25,
-    RT_MASK1_TORQUE_TILT_SETPOINT = 1 << 26,
-    RT_MASK1_TURN_TILT_SETPOINT = 1 << 27,
-    RT_MASK1_REMOTE_SETPOINT = 1 << 28,
-    RT_MASK1_BALANCE_CURRENT = 1 << 29,
-    RT_MASK1_LOOP_FREQUENCY = 1 << 30,
-};
+static void rt_write_state_flags(Data *d, uint8_t *buffer, int32_t *ind) {
+    buffer_append_uint32(
+        buffer, encode_state_flags(&d->state, &d->footpad, &d->alert_tracker, d->beep_reason), ind
+    );
+}
 
-enum {
-    RT_MASK2_ODOMETER = 1 << 0,
-    RT_MASK2_DISTANCE_ABS = 1 << 1,
-    RT_MASK2_CHARGING_VOLTAGE = 1 << 2,
-    RT_MASK2_CHARGING_CURRENT = 1 << 3,
-    RT_MASK2_AMP_HOURS = 1 << 4,
-    RT_MASK2_AMP_HOURS_CHARGED = 1 << 5,
-    RT_MASK2_WATT_HOURS = 1 << 6,
-    RT_MASK2_WATT_HOURS_CHARGED = 1 << 7,
-    RT_MASK2_MOTOR_ID = 1 << 8,  // The FOC direct axis motor current
-    RT_MASK2_GNSS_LAT = 1 << 9,
-    RT_MASK2_GNSS_LON = 1 << 10,
-    RT_MASK2_GNSS_ALTITUDE = 1 << 11,
-    RT_MASK2_GNSS_SPEED = 1 << 12,
-    RT_MASK2_GNSS_ACCURACY = 1 << 13,
-    RT_MASK2_GNSS_LAST_UPDATE = 1 << 14,
+static void rt_write_odometer(Data *d, uint8_t *buffer, int32_t *ind) {
+    unused(d);
+    buffer_append_uint32(buffer, VESC_IF->mc_get_odometer(), ind);
+}
+
+// GNSS fields - lat/lon are always float64, the rest follow the use_f32 flag
+// Note: lat/lon are 8 byte values and the updates are not synchronized, so
+// it's possible to hit the exact moment between the high and low side
+// being updated and get an inconsistent read (different GNSS values are
+// obviously not synchronised between each other either).
+static void rt_write_gnss_lat(Data *d, uint8_t *buffer, int32_t *ind) {
+    unused(d);
+    buffer_append_float64(buffer, VESC_IF->mc_gnss()->lat, ind);
+}
+
+static void rt_write_gnss_lon(Data *d, uint8_t *buffer, int32_t *ind) {
+    unused(d);
+    buffer_append_float64(buffer, VESC_IF->mc_gnss()->lon, ind);
+}
+
+static void rt_write_gnss_last_update(Data *d, uint8_t *buffer, int32_t *ind) {
+    unused(d);
+    buffer_append_uint32(buffer, VESC_IF->mc_gnss()->last_update, ind);
+}
+
+static float rt_get_battery_soc(Data *d) {
+    unused(d);
+    return VESC_IF->mc_get_battery_level(NULL);
+}
+
+static float rt_get_distance_abs(Data *d) {
+    unused(d);
+    return VESC_IF->mc_get_distance_abs();
+}
+
+static float rt_get_amp_hours(Data *d) {
+    unused(d);
+    return VESC_IF->mc_get_amp_hours(false);
+}
+
+static float rt_get_amp_hours_charged(Data *d) {
+    unused(d);
+    return VESC_IF->mc_get_amp_hours_charged(false);
+}
+
+static float rt_get_watt_hours(Data *d) {
+    unused(d);
+    return VESC_IF->mc_get_watt_hours(false);
+}
+
+static float rt_get_watt_hours_charged(Data *d) {
+    unused(d);
+    return VESC_IF->mc_get_watt_hours_charged(false);
+}
+
+static float rt_get_motor_id(Data *d) {
+    unused(d);
+    return VESC_IF->foc_get_id();
+}
+
+static float rt_get_gnss_altitude(Data *d) {
+    unused(d);
+    return VESC_IF->mc_gnss()->height;
+}
+
+static float rt_get_gnss_speed(Data *d) {
+    unused(d);
+    return VESC_IF->mc_gnss()->speed * 3.6f;
+}
+
+static float rt_get_gnss_accuracy(Data *d) {
+    unused(d);
+    return VESC_IF->mc_gnss()->hdop;
+}
+
+#define RT_FIELD(field, q) {.type = RT_TYPE_FIELD, .offset = offsetof(Data, field), .quantum = q}
+#define RT_GETTER(getter, q) {.type = RT_TYPE_GETTER, .quantum = q, .get = getter}
+#define RT_RAW(writer) {.type = RT_TYPE_RAW, .write = writer}
+
+static const RtItem rt_items[REALTIME_DATA_ITEMS_MAX] = {
+    [RT_ITEM_EXTRA_FLAGS] = RT_RAW(rt_write_extra_flags),
+    [RT_ITEM_STATE_FLAGS] = RT_RAW(rt_write_state_flags),
+    [RT_ITEM_SPEED] = RT_FIELD(motor.speed, 0.1f),
+    [RT_ITEM_ERPM] = RT_FIELD(motor.erpm, 10.0f),
+    [RT_ITEM_CURRENT] = RT_FIELD(motor.current, 0.1f),
+    [RT_ITEM_DIR_CURRENT] = RT_FIELD(motor.dir_current, 0.1f),
+    [RT_ITEM_FILT_CURRENT] = RT_FIELD(motor.filt_current.value, 0.1f),
+    [RT_ITEM_DUTY_CYCLE] = RT_FIELD(motor.duty_cycle.value, 0.002f),
+    [RT_ITEM_BATTERY_VOLTAGE] = RT_FIELD(motor.batt_voltage, 0.05f),
+    [RT_ITEM_BATTERY_CURRENT] = RT_FIELD(motor.batt_current.value, 0.1f),
+    [RT_ITEM_BATTERY_SOC] = RT_GETTER(rt_get_battery_soc, 0.002f),
+    [RT_ITEM_MOSFET_TEMP] = RT_FIELD(motor.mosfet_temp, 0.2f),
+    [RT_ITEM_MOTOR_TEMP] = RT_FIELD(motor.motor_temp, 0.2f),
+    [RT_ITEM_PITCH] = RT_FIELD(imu.pitch, 0.05f),
+    [RT_ITEM_BALANCE_PITCH] = RT_FIELD(imu.balance_pitch, 0.05f),
+    [RT_ITEM_ROLL] = RT_FIELD(imu.roll, 0.05f),
+    [RT_ITEM_ADC_LEFT] = RT_FIELD(footpad.adc_left, 0.01f),
+    [RT_ITEM_ADC_RIGHT] = RT_FIELD(footpad.adc_right, 0.01f),
+    [RT_ITEM_REMOTE_INPUT] = RT_FIELD(remote.input, 0.01f),
+    [RT_ITEM_SETPOINT] = RT_FIELD(setpoint, 0.05f),
+    [RT_ITEM_ATR_SETPOINT] = RT_FIELD(atr.setpoint.value, 0.05f),
+    [RT_ITEM_BRAKE_TILT_SETPOINT] = RT_FIELD(brake_tilt.setpoint.value, 0.05f),
+    [RT_ITEM_TORQUE_TILT_SETPOINT] = RT_FIELD(torque_tilt.setpoint.value, 0.05f),
+    [RT_ITEM_TURN_TILT_SETPOINT] = RT_FIELD(turn_tilt.setpoint.value, 0.05f),
+    [RT_ITEM_REMOTE_SETPOINT] = RT_FIELD(remote.setpoint.value, 0.05f),
+    [RT_ITEM_BALANCE_CURRENT] = RT_FIELD(balance_current.value, 0.1f),
+    [RT_ITEM_LOOP_FREQUENCY] = RT_FIELD(imu_freq_tracker.frequency.value, 1.0f),
+
+    [RT_ITEM_ODOMETER] = RT_RAW(rt_write_odometer),
+    [RT_ITEM_DISTANCE_ABS] = RT_GETTER(rt_get_distance_abs, 1.0f),
+    [RT_ITEM_CHARGING_VOLTAGE] = RT_FIELD(charging.voltage, 0.05f),
+    [RT_ITEM_CHARGING_CURRENT] = RT_FIELD(charging.current, 0.05f),
+    [RT_ITEM_AMP_HOURS] = RT_GETTER(rt_get_amp_hours, 0.001f),
+    [RT_ITEM_AMP_HOURS_CHARGED] = RT_GETTER(rt_get_amp_hours_charged, 0.001f),
+    [RT_ITEM_WATT_HOURS] = RT_GETTER(rt_get_watt_hours, 0.01f),
+    [RT_ITEM_WATT_HOURS_CHARGED] = RT_GETTER(rt_get_watt_hours_charged, 0.01f),
+    [RT_ITEM_MOTOR_ID] = RT_GETTER(rt_get_motor_id, 0.1f),
+    [RT_ITEM_GNSS_LAT] = RT_RAW(rt_write_gnss_lat),
+    [RT_ITEM_GNSS_LON] = RT_RAW(rt_write_gnss_lon),
+    [RT_ITEM_GNSS_ALTITUDE] = RT_GETTER(rt_get_gnss_altitude, 0.5f),
+    [RT_ITEM_GNSS_SPEED] = RT_GETTER(rt_get_gnss_speed, 0.1f),
+    [RT_ITEM_GNSS_ACCURACY] = RT_GETTER(rt_get_gnss_accuracy, 0.1f),
+    [RT_ITEM_GNSS_LAST_UPDATE] = RT_RAW(rt_write_gnss_last_update),
 };
 
+#undef RT_FIELD
+#undef RT_GETTER
+#undef RT_RAW
+
+// Precomputes the list of items to serialize for the masks. Bits of unknown
+// items are skipped.
+static void realtime_data_plan_build(RealtimeDataPlan *plan, uint32_t mask1, uint32_t mask2) {
+    plan->mask1 = mask1;
+    plan->mask2 = mask2;
+    plan->count = 0;
+
+    uint64_t mask = (uint64_t) mask2 << 32 | mask1;
+    for (uint8_t i = 0; i < REALTIME_DATA_ITEMS_MAX; ++i) {
+        if ((mask & (1ull << i)) && rt_items[i].type != RT_TYPE_NONE) {
+            plan->items[plan->count++] = i;
+        }
+    }
+}
+
+// Size of the REALTIME_DATA payload (without the command header): 9B header +
+// 4B time + 8B changed masks + (64 fields * 4B) + (2 * 4B extra for GNSS
+// lat/lon float64s)
+#define REALTIME_DATA_MAX_SIZE 285
+
+// Appends the REALTIME_DATA payload with the items of the plan. If last_values
+// is not NULL, writes a delta frame: only the items which changed by at least
+// their quantum since the previous frame are written and marked in the
+// changed masks.
+static void append_realtime_data(
+    Data *d,
+    uint8_t *buffer,
+    int32_t *index,
+    uint8_t control_flags,
+    const RealtimeDataPlan *plan,
+    float *last_values,
+    bool keyframe
+) {
+    bool use_f32 = control_flags & 0x1;
+    int32_t ind = *index;
+
+    buffer[ind++] = control_flags;
+    buffer_append_uint32(buffer, plan->mask1, &ind);
+    buffer_append_uint32(buffer, plan->mask2, &ind);
+
+    buffer_append_uint32(buffer, d->time.now, &ind);
+
+    RtFrameWriter w;
+    rt_frame_begin(&w, buffer, ind, use_f32, last_values, keyframe);
+    for (uint8_t i = 0; i < plan->count; ++i) {
+        uint8_t item_index = plan->items[i];
+        const RtItem *item = &rt_items[item_index];
+
+        if (item->type == RT_TYPE_RAW) {
+            item->write(d, w.buffer, &w.ind);
+            rt_frame_mark_raw(&w, item_index);
+            continue;
+        }
+
+        float value = item->type == RT_TYPE_FIELD
+            ? *(const float *) ((const uint8_t *) d + item->offset)
+            : item->get(d);
+        rt_frame_write_value(&w, item_index, value, item->quantum);
+    }
+
+    *index = rt_frame_end(&w);
+}
+
 static void cmd_realtime_data(Data *d, uint8_t *buf, int len) {
     if (len < 5) {
         return;
@@ -2071,7 +2480,6 @@ static void cmd_realtime_data(Data *d, uint8_t *buf, int len) {
 
     int32_t ind = 0;
     uint8_t control_flags = buf[ind++];
-    bool use_f32 = control_flags & 0x1;
 
     uint32_t mask1 = buffer_get_uint32(buf, &ind);
     uint32_t mask2 = 0;
@@ -2080,126 +2488,120 @@ static void cmd_realtime_data(Data *d, uint8_t *buf, int len) {
         mask2 = buffer_get_uint32(buf, &ind);
     }
 
-    // 11B header + 4B time + (64 fields * 4B) + (2 * 4B extra for GNSS lat/lon float64s)
-    static const int bufsize = 279;
+    static const int bufsize = 2 + REALTIME_DATA_MAX_SIZE;
     uint8_t buffer[bufsize];
     ind = 0;
 
     buffer[ind++] = 101;  // Package ID
     buffer[ind++] = COMMAND_REALTIME_DATA;
 
-    buffer[ind++] = control_flags;
-    buffer_append_uint32(buffer, mask1, &ind);
-    buffer_append_uint32(buffer, mask2, &ind);
+    // the plan of the last request is cached, clients typically keep
+    // requesting the same masks
+    if (mask1 != d->rt_plan.mask1 || mask2 != d->rt_plan.mask2) {
+        realtime_data_plan_build(&d->rt_plan, mask1, mask2);
+    }
 
-    buffer_append_uint32(buffer, d->time.now, &ind);
+    // delta frames only make sense for the subscription
+    control_flags &= ~0x2;
+    append_realtime_data(d, buffer, &ind, control_flags, &d->rt_plan, NULL, false);
 
-    if (mask1 & RT_MASK1_EXTRA_FLAGS) {
-        buffer[ind++] = encode_extra_flags(&d->data_record);
+    SEND_APP_DATA(buffer, bufsize, ind);
+}
+
+// Called from the aux thread, which owns the subscription, through the command
+// queue. Replaces the subscription by the one in the request.
+static void realtime_data_subscribe(Data *d, const uint8_t *buf, size_t len) {
+    RealtimeDataSubscription *sub = &d->rt_subscription;
+    sub->active = false;
+
+    int32_t ind = 0;
+    sub->control_flags = buf[ind++];
+    uint32_t mask1 = buffer_get_uint32(buf, &ind);
+    uint32_t mask2 = buffer_get_uint32(buf, &ind);
+    realtime_data_plan_build(&sub->plan, mask1, mask2);
+    uint8_t rate = buf[ind++];
+    uint8_t timeout = len >= 11 ? buf[ind++] : 0;
+
+    if (rate == 0) {  // unsubscribe
+        return;
     }
 
-    if (mask1 & RT_MASK1_STATE_FLAGS) {
-        buffer_append_uint32(
-            buffer,
-            encode_state_flags(&d->state, &d->footpad, &d->alert_tracker, d->beep_reason),
-            &ind
-        );
+    sub->period = SYSTEM_TICK_RATE_HZ / rate;
+    sub->timeout = timeout > 0 ? timeout : REALTIME_DATA_SUBSCRIPTION_TIMEOUT;
+    sub->seq = 0;
+    sub->keyframe_requested = false;
+    timer_refresh(&d->time, &sub->keepalive_timer);
+    timer_expire(&d->time, &sub->frame_timer, 1);
+    sub->active = true;
+}
+
+static void cmd_realtime_data_subscribe(Data *d, uint8_t *buf, int len) {
+    RealtimeDataSubscription *sub = &d->rt_subscription;
+
+    // a request without parameters (or just the flags) is a keepalive of the
+    // current subscription
+    if (len <= 1) {
+        if (len == 1 && buf[0] & 0x1) {
+            // the client lost a delta frame, resynchronize by a keyframe
+            sub->keyframe_requested = true;
+        }
+        timer_refresh(&d->time, &sub->keepalive_timer);
+        return;
     }
 
-    // MASK1
-    add_rt_item(buffer, &ind, mask1, RT_MASK1_SPEED, d->motor.speed, use_f32);
-    add_rt_item(buffer, &ind, mask1, RT_MASK1_ERPM, d->motor.erpm, use_f32);
-    add_rt_item(buffer, &ind, mask1, RT_MASK1_CURRENT, d->motor.current, use_f32);
-    add_rt_item(buffer, &ind, mask1, RT_MASK1_DIR_CURRENT, d->motor.dir_current, use_f32);
-    add_rt_item(buffer, &ind, mask1, RT_MASK1_FILT_CURRENT, d->motor.filt_current.value, use_f32);
-    add_rt_item(buffer, &ind, mask1, RT_MASK1_DUTY_CYCLE, d->motor.duty_cycle.value, use_f32);
-    add_rt_item(buffer, &ind, mask1, RT_MASK1_BATTERY_VOLTAGE, d->motor.batt_voltage, use_f32);
-    add_rt_item(
-        buffer, &ind, mask1, RT_MASK1_BATTERY_CURRENT, d->motor.batt_current.value, use_f32
-    );
-    add_rt_item(
-        buffer, &ind, mask1, RT_MASK1_BATTERY_SOC, VESC_IF->mc_get_battery_level(NULL), use_f32
-    );
-    add_rt_item(buffer, &ind, mask1, RT_MASK1_MOSFET_TEMP, d->motor.mosfet_temp, use_f32);
-    add_rt_item(buffer, &ind, mask1, RT_MASK1_MOTOR_TEMP, d->motor.motor_temp, use_f32);
-    add_rt_item(buffer, &ind, mask1, RT_MASK1_PITCH, d->imu.pitch, use_f32);
-    add_rt_item(buffer, &ind, mask1, RT_MASK1_BALANCE_PITCH, d->imu.balance_pitch, use_f32);
-    add_rt_item(buffer, &ind, mask1, RT_MASK1_ROLL, d->imu.roll, use_f32);
-    add_rt_item(buffer, &ind, mask1, RT_MASK1_ADC_LEFT, d->footpad.adc_left, use_f32);
-    add_rt_item(buffer, &ind, mask1, RT_MASK1_ADC_RIGHT, d->footpad.adc_right, use_f32);
-    add_rt_item(buffer, &ind, mask1, RT_MASK1_REMOTE_INPUT, d->remote.input, use_f32);
-    add_rt_item(buffer, &ind, mask1, RT_MASK1_SETPOINT, d->setpoint, use_f32);
-    add_rt_item(buffer, &ind, mask1, RT_MASK1_ATR_SETPOINT, d->atr.setpoint.value, use_f32);
-    add_rt_item(
-        buffer, &ind, mask1, RT_MASK1_BRAKE_TILT_SETPOINT, d->brake_tilt.setpoint.value, use_f32
-    );
-    add_rt_item(
-        buffer, &ind, mask1, RT_MASK1_TORQUE_TILT_SETPOINT, d->torque_tilt.setpoint.value, use_f32
-    );
-    add_rt_item(
-        buffer, &ind, mask1, RT_MASK1_TURN_TILT_SETPOINT, d->turn_tilt.setpoint.value, use_f32
-    );
-    add_rt_item(buffer, &ind, mask1, RT_MASK1_REMOTE_SETPOINT, d->remote.setpoint.value, use_f32);
-    add_rt_item(buffer, &ind, mask1, RT_MASK1_BALANCE_CURRENT, d->balance_current.value, use_f32);
-    add_rt_item(
-        buffer, &ind, mask1, RT_MASK1_LOOP_FREQUENCY, d->imu_freq_tracker.frequency.value, use_f32
-    );
+    if (len < 10) {
+        log_error("Realtime data subscription missing data, length: %u", len);
+        return;
+    }
 
-    // MASK2
-    if (mask2 & RT_MASK2_ODOMETER) {
-        buffer_append_uint32(buffer, VESC_IF->mc_get_odometer(), &ind);
+    // the aux thread may be pushing a frame of the current subscription, the
+    // new one is applied in it, in between the frames
+    if (!command_queue_push(&d->command_queue, COMMAND_INTERNAL_RT_SUBSCRIBE, buf, min(len, 11))) {
+        log_error("Command queue full, realtime data subscription dropped.");
     }
-    add_rt_item(
-        buffer, &ind, mask2, RT_MASK2_DISTANCE_ABS, VESC_IF->mc_get_distance_abs(), use_f32
-    );
-    add_rt_item(buffer, &ind, mask2, RT_MASK2_CHARGING_VOLTAGE, d->charging.voltage, use_f32);
-    add_rt_item(buffer, &ind, mask2, RT_MASK2_CHARGING_CURRENT, d->charging.current, use_f32);
-    add_rt_item(buffer, &ind, mask2, RT_MASK2_AMP_HOURS, VESC_IF->mc_get_amp_hours(false), use_f32);
-    add_rt_item(
-        buffer,
-        &ind,
-        mask2,
-        RT_MASK2_AMP_HOURS_CHARGED,
-        VESC_IF->mc_get_amp_hours_charged(false),
-        use_f32
-    );
-    add_rt_item(
-        buffer, &ind, mask2, RT_MASK2_WATT_HOURS, VESC_IF->mc_get_watt_hours(false), use_f32
-    );
-    add_rt_item(
+}
+
+// Called from the aux thread, pushes a REALTIME_DATA frame to the subscribed
+// client when it's due.
+static void push_realtime_data(Data *d) {
+    RealtimeDataSubscription *sub = &d->rt_subscription;
+    if (!sub->active) {
+        return;
+    }
+
+    if (timer_older(&d->time, sub->keepalive_timer, sub->timeout)) {
+        sub->active = false;
+        return;
+    }
+
+    if (d->time.now - sub->frame_timer < sub->period) {
+        return;
+    }
+    timer_refresh(&d->time, &sub->frame_timer);
+
+    static const int bufsize = 2 + 2 + REALTIME_DATA_MAX_SIZE;
+    uint8_t buffer[bufsize];
+    int32_t ind = 0;
+
+    buffer[ind++] = 101;  // Package ID
+    buffer[ind++] = COMMAND_REALTIME_DATA_SUBSCRIBE;
+
+    bool delta = sub->control_flags & 0x2;
+    bool keyframe = sub->keyframe_requested || sub->seq % REALTIME_DATA_KEYFRAME_INTERVAL == 0;
+    sub->keyframe_requested = false;
+
+    buffer_append_uint16(buffer, sub->seq++, &ind);
+    append_realtime_data(
+        d,
         buffer,
         &ind,
-        mask2,
-        RT_MASK2_WATT_HOURS_CHARGED,
-        VESC_IF->mc_get_watt_hours_charged(false),
-        use_f32
+        sub->control_flags,
+        &sub->plan,
+        delta ? sub->last_values : NULL,
+        keyframe
     );
-    add_rt_item(buffer, &ind, mask2, RT_MASK2_MOTOR_ID, VESC_IF->foc_get_id(), use_f32);
 
-    // GNSS fields - lat/lon are always float64, the rest follow the use_f32 flag
-    // Note: lat/lon are 8 byte values and the updates are not synchronized, so
-    // it's possible to hit the exact moment between the high and low side
-    // being updated and get an inconsistent read (different GNSS values are
-    // obviously not synchronised between each other either).
-    if (mask2 &
-        (RT_MASK2_GNSS_LAT | RT_MASK2_GNSS_LON | RT_MASK2_GNSS_ALTITUDE | RT_MASK2_GNSS_SPEED |
-         RT_MASK2_GNSS_ACCURACY | RT_MASK2_GNSS_LAST_UPDATE)) {
-        volatile gnss_data *gnss = VESC_IF->mc_gnss();
-        if (mask2 & RT_MASK2_GNSS_LAT) {
-            buffer_append_float64(buffer, gnss->lat, &ind);
-        }
-        if (mask2 & RT_MASK2_GNSS_LON) {
-            buffer_append_float64(buffer, gnss->lon, &ind);
-        }
-        add_rt_item(buffer, &ind, mask2, RT_MASK2_GNSS_ALTITUDE, gnss->height, use_f32);
-        add_rt_item(buffer, &ind, mask2, RT_MASK2_GNSS_SPEED, gnss->speed * 3.6f, use_f32);
-        add_rt_item(buffer, &ind, mask2, RT_MASK2_GNSS_ACCURACY, gnss->hdop, use_f32);
-        if (mask2 & RT_MASK2_GNSS_LAST_UPDATE) {
-            buffer_append_uint32(buffer, gnss->last_update, &ind);
-        }
-    }
-
-    SEND_APP_DATA(buffer, bufsize, ind);
+    SEND_APP_DATA_DIRECT(buffer, bufsize, ind);
 }
 
 static void buffer_append_fault_name(uint8_t *buffer, mc_fault_code code, int32_t *index) {
@@ -2311,6 +2713,30 @@ static void lights_control_response(const Leds *leds) {
     SEND_APP_DATA(buffer, bufsize, ind);
 }
 
+static void cmd_leds_stats(LedDriver *driver, uint8_t *buf, size_t len) {
+    uint8_t flags = len >= 1 ? buf[0] : 0;
+
+    static const int bufsize = 22;
+    uint8_t buffer[bufsize];
+    int32_t ind = 0;
+
+    buffer[ind++] = 101;  // Package ID
+    buffer[ind++] = COMMAND_LEDS_STATS;
+
+    const LedDriverStats *stats = led_driver_get_stats(driver);
+    buffer_append_uint32(buffer, stats->frames, &ind);
+    buffer_append_uint32(buffer, stats->frames_skipped, &ind);
+    buffer_append_uint32(buffer, stats->leds_encoded, &ind);
+    buffer_append_uint32(buffer, driver->bitbuffer_length * sizeof(uint16_t), &ind);
+    buffer_append_uint32(buffer, stats->underruns, &ind);
+
+    SEND_APP_DATA(buffer, bufsize, ind);
+
+    if (flags & 0x1) {
+        led_driver_reset_stats(driver);
+    }
+}
+
 static void cmd_info(const Data *d, unsigned char *buf, int len) {
     static const int bufsize = 4 + 20 + 3 + 20 + 13;
     uint8_t version = 1;
@@ -2365,6 +2791,9 @@ static void cmd_info(const Data *d, unsigned char *buf, int len) {
         uint32_t capabilities = 0;
         if (data_recorder_has_capability(&d->data_record)) {
             capabilities |= 1 << 31;
+            if (data_recorder_is_fallback(&d->data_record)) {
+                capabilities |= 1 << 30;
+            }
         }
         if (d->float_conf.hardware.leds.mode != LED_MODE_OFF) {
             capabilities |= 1;
@@ -2390,56 +2819,104 @@ static void cmd_info(const Data *d, unsigned char *buf, int len) {
     SEND_APP_DATA(send_buffer, bufsize, ind);
 }
 
-// Handler for incoming app commands
-static void on_command_received(unsigned char *buffer, unsigned int len) {
-    Data *d = (Data *) ARG;
-    if (len < 2) {
-        log_error("Received command data too short: %u bytes.", len);
-        return;
-    }
+// Status of a command in the QUEUED_COMPLETED message
+enum {
+    QUEUED_STATUS_COMPLETED = 0,
+    QUEUED_STATUS_QUEUE_FULL = 1,  // dropped, the command wasn't run
+    QUEUED_STATUS_TOO_LONG = 2,  // dropped, the command data didn't fit into the queue
+};
 
-    uint8_t magicnr = buffer[0];
-    uint8_t command = buffer[1];
-    if (magicnr != 101) {
-        log_error("Invalid Package ID: %u", (unsigned) magicnr);
-        return;
+static void send_queued_completed(
+    uint8_t command,
+    uint8_t status,
+    float wait_ms,
+    float run_ms,
+    uint16_t dropped,
+    bool command_thread
+) {
+    static const int bufsize = 10;
+    uint8_t buffer[bufsize];
+    int32_t ind = 0;
+
+    buffer[ind++] = 101;  // Package ID
+    buffer[ind++] = COMMAND_QUEUED_COMPLETED;
+    buffer[ind++] = command;
+    buffer[ind++] = status;
+    buffer_append_uint16(buffer, min(wait_ms, 65535.0f), &ind);
+    buffer_append_uint16(buffer, min(run_ms, 65535.0f), &ind);
+    buffer_append_uint16(buffer, dropped, &ind);
+
+    if (command_thread) {
+        SEND_APP_DATA(buffer, bufsize, ind);
+    } else {
+        SEND_APP_DATA_DIRECT(buffer, bufsize, ind);
     }
+}
 
-    switch (command) {
-    case COMMAND_INFO: {
-        cmd_info(d, &buffer[2], len - 2);
-        return;
+// Queues a command which is too slow to be run in the command thread (e.g. it
+// writes the EEPROM or reconfigures the package), to be run by the aux thread.
+// The commands which modify the config are all queued, to keep their order.
+// Returns false if the command was dropped. Must be called with the command
+// lock held, the queue takes a single producer at a time.
+static bool queue_command(Data *d, uint8_t command, uint8_t *data, size_t len) {
+    CommandQueue *q = &d->command_queue;
+    if (len > QUEUED_COMMAND_DATA_MAX) {
+        log_error("Command %u data too long to be queued: %u", command, len);
+        send_queued_completed(command, QUEUED_STATUS_TOO_LONG, 0, 0, q->dropped, true);
+        return false;
+    } else if (!command_queue_push(q, command, data, len)) {
+        log_error("Command queue full, command %u dropped.", command);
+        send_queued_completed(command, QUEUED_STATUS_QUEUE_FULL, 0, 0, q->dropped, true);
+        return false;
     }
-    case COMMAND_GET_RTDATA: {
-        send_realtime_data(d);
-        return;
+    return true;
+}
+
+// Applies and writes the config from VESC Tool, takes ownership of cfg.
+static void cmd_set_cfg(Data *d, RefloatConfig *cfg) {
+    // a special mode could have been entered since the config was queued
+    if (d->state.mode == MODE_NORMAL) {
+        d->float_conf = *cfg;
+
+        // don't allow to disable the package in the RUNNING state
+        if (d->state.state == STATE_RUNNING) {
+            d->float_conf.disabled = false;
+        }
+
+        // Always reset the is_default flag on writing - whatever we write we
+        // consider to not be the default config anymore
+        d->float_conf.meta.is_default = false;
+
+        write_cfg_to_eeprom(d);
+        configure(d);
     }
+    VESC_IF->free(cfg);
+}
+
+static void run_queued_command(Data *d, QueuedCommand *c) {
+    switch (c->command) {
     case COMMAND_RT_TUNE: {
-        cmd_runtime_tune(d, &buffer[2], len - 2);
+        cmd_runtime_tune(d, c->data, c->len);
         return;
     }
     case COMMAND_TUNE_OTHER: {
-        if (len >= 14) {
-            cmd_runtime_tune_other(d, &buffer[2], len - 2);
+        if (c->len >= 12) {
+            cmd_runtime_tune_other(d, c->data, c->len);
         } else {
-            log_error("Command data length incorrect: %u", len);
+            log_error("Command data length incorrect: %u", c->len);
         }
         return;
     }
     case COMMAND_TUNE_TILT: {
-        if (len >= 7) {
-            cmd_runtime_tune_tilt(d, &buffer[2], len - 2);
+        if (c->len >= 5) {
+            cmd_runtime_tune_tilt(d, c->data, c->len);
         } else {
-            log_error("Command data length incorrect: %u", len);
+            log_error("Command data length incorrect: %u", c->len);
         }
         return;
     }
-    case COMMAND_REMOTE: {
-        cmd_remote(d, &buffer[2], len - 2);
-        return;
-    }
     case COMMAND_CFG_RESTORE: {
-        read_cfg_from_eeprom(d);
+        read_cfg_from_eeprom(d, true);
         return;
     }
     case COMMAND_TUNE_DEFAULTS: {
@@ -2450,46 +2927,222 @@ static void on_command_received(unsigned char *buffer, unsigned int len) {
         write_cfg_to_eeprom(d);
         return;
     }
-    case COMMAND_PRINT_INFO: {
-        cmd_print_info(d);
+    case COMMAND_BOOSTER: {
+        if (c->len == 4) {
+            cmd_booster(d, c->data);
+        } else {
+            log_error("Command data length incorrect: %u", c->len);
+        }
         return;
     }
-    case COMMAND_GET_ALLDATA: {
-        if (len == 3) {
-            cmd_send_all_data(d, buffer[2]);
+    case COMMAND_FLYWHEEL: {
+        if (c->len >= 6) {
+            cmd_flywheel_toggle(d, c->data, c->len);
         } else {
-            log_error("Command data length incorrect: %u", len);
+            log_error("Command data length incorrect: %u", c->len);
         }
         return;
     }
-    case COMMAND_EXPERIMENT: {
-        cmd_experiment(d, &buffer[2]);
+    case COMMAND_TUNE_PROFILES: {
+        tune_profiles_request(&d->tune_profiles, &d->float_conf, c->data, c->len);
+        return;
+    }
+    case COMMAND_LED_PROGRAMS: {
+        led_programs_request(&d->leds.programs, c->data, c->len);
         return;
     }
     case COMMAND_LOCK: {
-        cmd_lock(d, &buffer[2]);
+        if (c->len >= 1) {
+            cmd_lock(d, c->data);
+        } else {
+            log_error("Command data length incorrect: %u", c->len);
+        }
         return;
     }
     case COMMAND_HANDTEST: {
-        cmd_handtest(d, &buffer[2]);
+        if (c->len >= 1) {
+            cmd_handtest(d, c->data);
+        } else {
+            log_error("Command data length incorrect: %u", c->len);
+        }
         return;
     }
-    case COMMAND_BOOSTER: {
-        if (len == 6) {
-            cmd_booster(d, &buffer[2]);
+    case COMMAND_INTERNAL_RT_SUBSCRIBE: {
+        realtime_data_subscribe(d, c->data, c->len);
+        return;
+    }
+    case COMMAND_INTERNAL_SET_CFG: {
+        RefloatConfig *cfg;
+        memcpy(&cfg, c->data, sizeof(cfg));
+        cmd_set_cfg(d, cfg);
+        return;
+    }
+    }
+}
+
+// Frees the resources held by the commands left in the queue, on stop.
+static void clear_command_queue(Data *d) {
+    QueuedCommand *c;
+    while ((c = command_queue_front(&d->command_queue))) {
+        if (c->command == COMMAND_INTERNAL_SET_CFG) {
+            RefloatConfig *cfg;
+            memcpy(&cfg, c->data, sizeof(cfg));
+            VESC_IF->free(cfg);
+        }
+        command_queue_pop(&d->command_queue);
+    }
+}
+
+// Called from the aux thread, runs all queued commands and sends a completion
+// message with the time the command waited in the queue and its run time.
+static void process_command_queue(Data *d) {
+    QueuedCommand *c;
+    while ((c = command_queue_front(&d->command_queue))) {
+        // don't read, modify or save the config while a profile switch is being applied
+        tune_profiles_wait_applied(&d->tune_profiles);
+
+        systime_t start = vesc_system_time_ticks();
+        run_queued_command(d, c);
+        systime_t end = vesc_system_time_ticks();
+
+        if (c->command >= COMMAND_INTERNAL_RT_SUBSCRIBE) {
+            command_queue_pop(&d->command_queue);
+            continue;
+        }
+
+        send_queued_completed(
+            c->command,
+            QUEUED_STATUS_COMPLETED,
+            (start - c->queued_time) * 1000.0f / SYSTEM_TICK_RATE_HZ,
+            (end - start) * 1000.0f / SYSTEM_TICK_RATE_HZ,
+            d->command_queue.dropped,
+            false
+        );
+        command_queue_pop(&d->command_queue);
+    }
+}
+
+// Status flags of a sub-command in the BATCH reply
+enum {
+    BATCH_STATUS_INCLUDED = 0x1,  // the response is included in the reply
+    BATCH_STATUS_SEPARATE = 0x2,  // (other) responses were sent in separate messages
+    BATCH_STATUS_REJECTED = 0x4,  // the sub-command can't be batched and wasn't run
+};
+
+// Size of the per-sub-command header in the BATCH reply
+#define BATCH_ENTRY_HEADER_SIZE 4
+
+static void cmd_batch(Data *d, unsigned char *buf, size_t len) {
+    CommandBatch *batch = &d->command_batch;
+    if (len < 1) {
+        log_error("Command data length incorrect: %u", len);
+        return;
+    }
+
+    size_t i = 0;
+    uint8_t requested = buf[i++];
+
+    int32_t ind = 0;
+    batch->buffer[ind++] = 101;  // Package ID
+    batch->buffer[ind++] = COMMAND_BATCH;
+    int32_t count_ind = ind++;
+
+    uint8_t count = 0;
+    while (count < requested && ind + BATCH_ENTRY_HEADER_SIZE <= SEND_BUF_MAX_SIZE) {
+        // sub-command: length (u8), command_id, data
+        if (i >= len || buf[i] == 0 || i + 1 + buf[i] > len) {
+            log_error("Batch sub-command %u malformed.", count);
+            break;
+        }
+        uint8_t sub_len = buf[i];
+        uint8_t command = buf[i + 1];
+
+        batch->command = command;
+        batch->status = 0;
+        batch->ind = ind + BATCH_ENTRY_HEADER_SIZE;
+        if (command == COMMAND_BATCH) {
+            batch->status = BATCH_STATUS_REJECTED;
         } else {
-            log_error("Command data length incorrect: %u", len);
+            // Overwrite the length, which was already read, with the Package
+            // ID, to pass the sub-command on in place with its header.
+            buf[i] = 101;
+            batch->active = true;
+            handle_command(&buf[i], 1 + sub_len);
+            batch->active = false;
         }
+
+        batch->buffer[ind++] = command;
+        batch->buffer[ind++] = batch->status;
+        buffer_append_uint16(batch->buffer, batch->ind - ind - 2, &ind);
+        ind = batch->ind;
+
+        i += 1 + sub_len;
+        ++count;
+    }
+
+    batch->buffer[count_ind] = count;
+    SEND_APP_DATA(batch->buffer, SEND_BUF_MAX_SIZE, ind);
+}
+
+// Runs an app command, with the command lock held
+static void handle_command(unsigned char *buffer, unsigned int len) {
+    Data *d = (Data *) ARG;
+    if (len < 2) {
+        log_error("Received command data too short: %u bytes.", len);
         return;
     }
-    case COMMAND_FLYWHEEL: {
-        if (len >= 8) {
-            cmd_flywheel_toggle(d, &buffer[2], len - 2);
+
+    uint8_t magicnr = buffer[0];
+    uint8_t command = buffer[1];
+    if (magicnr != 101) {
+        log_error("Invalid Package ID: %u", (unsigned) magicnr);
+        return;
+    }
+
+    switch (command) {
+    case COMMAND_INFO: {
+        cmd_info(d, &buffer[2], len - 2);
+        return;
+    }
+    case COMMAND_GET_RTDATA: {
+        send_realtime_data(d);
+        return;
+    }
+    case COMMAND_RT_TUNE:
+    case COMMAND_TUNE_OTHER:
+    case COMMAND_TUNE_TILT:
+    case COMMAND_CFG_RESTORE:
+    case COMMAND_TUNE_DEFAULTS:
+    case COMMAND_CFG_SAVE:
+    case COMMAND_BOOSTER:
+    case COMMAND_FLYWHEEL:
+    case COMMAND_TUNE_PROFILES:
+    case COMMAND_LED_PROGRAMS:
+    case COMMAND_LOCK:
+    case COMMAND_HANDTEST: {
+        queue_command(d, command, &buffer[2], len - 2);
+        return;
+    }
+    case COMMAND_REMOTE: {
+        cmd_remote(d, &buffer[2], len - 2);
+        return;
+    }
+    case COMMAND_PRINT_INFO: {
+        cmd_print_info(d);
+        return;
+    }
+    case COMMAND_GET_ALLDATA: {
+        if (len == 3) {
+            cmd_send_all_data(d, buffer[2]);
         } else {
             log_error("Command data length incorrect: %u", len);
         }
         return;
     }
+    case COMMAND_EXPERIMENT: {
+        cmd_experiment(d, &buffer[2]);
+        return;
+    }
     case COMMAND_LCM_POLL: {
         lcm_poll_request(&d->lcm, &buffer[2], len - 2);
         lcm_poll_response(&d->lcm, &d->state, d->footpad.state, &d->motor, d->imu.pitch);
@@ -2527,11 +3180,23 @@ static void on_command_received(unsigned char *buffer, unsigned int len) {
         cmd_realtime_data(d, &buffer[2], len - 2);
         return;
     }
+    case COMMAND_REALTIME_DATA_SUBSCRIBE: {
+        cmd_realtime_data_subscribe(d, &buffer[2], len - 2);
+        return;
+    }
     case COMMAND_LIGHTS_CONTROL: {
         lights_control_request(&d->leds, &buffer[2], len - 2, &d->lcm);
         lights_control_response(&d->leds);
         return;
     }
+    case COMMAND_LEDS_STATS: {
+        cmd_leds_stats(&d->leds.led_driver, &buffer[2], len - 2);
+        return;
+    }
+    case COMMAND_RIDE_STATS: {
+        ride_stats_request(&d->ride_stats, &buffer[2], len - 2);
+        return;
+    }
     case COMMAND_DATA_RECORD: {
         data_recorder_request(&d->data_record, &buffer[2], len - 2);
         return;
@@ -2544,6 +3209,10 @@ static void on_command_received(unsigned char *buffer, unsigned int len) {
         cmd_alerts_control(&d->alert_tracker, &buffer[2], len - 2);
         return;
     }
+    case COMMAND_BATCH: {
+        cmd_batch(d, &buffer[2], len - 2);
+        return;
+    }
     default: {
         if (!VESC_IF->app_is_output_disabled()) {
             log_error("Unknown command received: %u", command);
@@ -2552,6 +3221,17 @@ static void on_command_received(unsigned char *buffer, unsigned int len) {
     }
 }
 
+// Handler for incoming app commands. It's called from the thread of each
+// interface (USB, UART, CAN...), the commands are serialized by the command
+// lock, so that e.g. a BATCH reply being collected doesn't catch the replies of
+// a command received over another interface.
+static void on_command_received(unsigned char *buffer, unsigned int len) {
+    Data *d = (Data *) ARG;
+    VESC_IF->mutex_lock(d->command_lock);
+    handle_command(buffer, len);
+    VESC_IF->mutex_unlock(d->command_lock);
+}
+
 // Called from Lisp on init to pass in the version info of the firmware
 static lbm_value ext_set_fw_version(lbm_value *args, lbm_uint argn) {
     Data *d = (Data *) ARG;
@@ -2607,7 +3287,9 @@ static int get_cfg(uint8_t *buffer, bool is_default) {
     return res;
 }
 
-// Used to set and write configuration from VESC Tool.
+// Used to set and write configuration from VESC Tool. The config is
+// deserialized here and queued to be applied and written by the aux thread,
+// in order with the config modifying app commands.
 static bool set_cfg(uint8_t *buffer) {
     Data *d = (Data *) ARG;
 
@@ -2616,24 +3298,26 @@ static bool set_cfg(uint8_t *buffer) {
         return false;
     }
 
-    bool res = confparser_deserialize_refloatconfig(buffer, &d->float_conf);
+    RefloatConfig *cfg = VESC_IF->malloc(sizeof(RefloatConfig));
+    if (!cfg) {
+        log_error("Failed to set config: Out of memory.");
+        return false;
+    }
 
-    // don't allow to disable the package in the RUNNING state
-    if (d->state.state == STATE_RUNNING) {
-        d->float_conf.disabled = false;
+    if (!confparser_deserialize_refloatconfig(buffer, cfg)) {
+        VESC_IF->free(cfg);
+        return false;
     }
 
-    // Always reset the is_default flag on writing - whatever we write we
-    // consider to not be the default config anymore
-    d->float_conf.meta.is_default = false;
+    // called from the thread of the interface, like the app commands
+    VESC_IF->mutex_lock(d->command_lock);
+    bool queued = queue_command(d, COMMAND_INTERNAL_SET_CFG, (uint8_t *) &cfg, sizeof(cfg));
+    VESC_IF->mutex_unlock(d->command_lock);
 
-    // Store to EEPROM
-    if (res) {
-        write_cfg_to_eeprom(d);
-        configure(d);
+    if (!queued) {
+        VESC_IF->free(cfg);
     }
-
-    return res;
+    return queued;
 }
 
 static int get_cfg_xml(uint8_t **buffer) {
@@ -2658,8 +3342,12 @@ static void stop(void *arg) {
         VESC_IF->request_terminate(d->main_thread);
     }
     log_msg("Terminating.");
+    clear_command_queue(d);
     motor_data_destroy(&d->motor);
     leds_destroy(&d->leds);
+    data_recorder_destroy(&d->data_record);
+    cfg_eeprom_image_set(d, NULL, 0);
+    VESC_IF->free(d->command_lock);
     VESC_IF->free(d);
 }
 
@@ -2677,6 +3365,12 @@ INIT_FUN(lib_info *info) {
     data_init(d);
     info->stop_fun = stop;
 
+    d->command_lock = VESC_IF->mutex_create();
+    if (!d->command_lock) {
+        log_error("Failed to create the command lock.");
+        return false;
+    }
+
     // Periodically called from the aux thread. Do the first refresh here to avoid races.
     motor_data_refresh_motor_config(
         &d->motor, d->float_conf.tiltback_lv, d->float_conf.tiltback_hv
@@ -2712,3 +3406,23 @@ INIT_FUN(lib_info *info) {
 void fatal_error_terminate() {
     stop(ARG);
 }
+
+void send_app_data(unsigned char *buffer, unsigned int len) {
+    Data *d = (Data *) ARG;
+    CommandBatch *batch = &d->command_batch;
+    if (batch->active) {
+        // only the first response of a sub-command goes into the batch reply,
+        // without the command header, the rest is sent separately
+        unsigned int size = len - 2;
+        if (!(batch->status & BATCH_STATUS_INCLUDED) && len >= 2 && buffer[1] == batch->command &&
+            batch->ind + size <= SEND_BUF_MAX_SIZE) {
+            memcpy(&batch->buffer[batch->ind], &buffer[2], size);
+            batch->ind += size;
+            batch->status |= BATCH_STATUS_INCLUDED;
+            return;
+        }
+        batch->status |= BATCH_STATUS_SEPARATE;
+    }
+
+    VESC_IF->send_app_data(buffer, len);
+}
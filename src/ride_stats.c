@@ -0,0 +1,186 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include "ride_stats.h"
+
+#include "conf/buffer.h"
+#include "lib/utils.h"
+#include "vesc_c_if.h"
+
+#include <math.h>
+
+static const float quantile_probabilities[RS_QUANTILE_COUNT] = {0.5f, 0.9f, 0.99f};
+
+void ride_stats_init(RideStats *rs) {
+    for (uint8_t i = 0; i < RS_CHANNEL_COUNT; ++i) {
+        for (uint8_t j = 0; j < RS_QUANTILE_COUNT; ++j) {
+            p2_quantile_init(&rs->quantiles[i][j], quantile_probabilities[j]);
+        }
+    }
+
+    ride_stats_reset(rs);
+}
+
+void ride_stats_reset(RideStats *rs) {
+    rs->reset_requested = false;
+    rs->duration_us = 0;
+    rs->sample_count = 0;
+
+    for (uint8_t i = 0; i < RS_CHANNEL_COUNT; ++i) {
+        running_stats_reset(&rs->channels[i]);
+        for (uint8_t j = 0; j < RS_QUANTILE_COUNT; ++j) {
+            p2_quantile_reset(&rs->quantiles[i][j]);
+        }
+    }
+
+    for (uint8_t i = 0; i < RS_DUTY_BINS; ++i) {
+        rs->duty_histogram[i] = 0;
+    }
+
+    for (uint8_t i = 0; i < RS_CURRENT_BINS; ++i) {
+        rs->current_histogram[i] = 0;
+    }
+
+    for (uint8_t i = 0; i < RS_SAT_COUNT; ++i) {
+        rs->sat_samples[i] = 0;
+    }
+}
+
+// Returns the histogram bin of the value, values out of the range fall into the
+// first or last bin.
+static uint8_t histogram_bin(float value, float min, float bin_width, uint8_t bins) {
+    float bin = (value - min) / bin_width;
+    if (bin < 0.0f) {
+        return 0;
+    }
+    return min((uint8_t) min(bin, 255.0f), bins - 1);
+}
+
+void ride_stats_update(RideStats *rs, const State *state, const MotorData *motor, float dt) {
+    if (rs->reset_requested) {
+        ride_stats_reset(rs);
+    }
+
+    if (state->state != STATE_RUNNING) {
+        return;
+    }
+
+    rs->duration_us += (uint32_t) (dt * 1e6f + 0.5f);
+    ++rs->sample_count;
+
+    float values[RS_CHANNEL_COUNT] = {
+        [RS_MOTOR_CURRENT] = motor->current,
+        [RS_BATTERY_CURRENT] = motor->batt_current.value,
+        [RS_DUTY_CYCLE] = motor->duty_cycle.value,
+        [RS_SPEED] = fabsf(motor->speed),
+        [RS_BATTERY_VOLTAGE] = motor->batt_voltage,
+        [RS_MOSFET_TEMP] = motor->mosfet_temp,
+        [RS_MOTOR_TEMP] = motor->motor_temp,
+    };
+
+    for (uint8_t i = 0; i < RS_CHANNEL_COUNT; ++i) {
+        running_stats_update(&rs->channels[i], values[i]);
+        for (uint8_t j = 0; j < RS_QUANTILE_COUNT; ++j) {
+            p2_quantile_update(&rs->quantiles[i][j], values[i]);
+        }
+    }
+
+    ++rs->duty_histogram[histogram_bin(
+        values[RS_DUTY_CYCLE], 0.0f, RS_DUTY_BIN_WIDTH, RS_DUTY_BINS
+    )];
+    ++rs->current_histogram[histogram_bin(
+        values[RS_MOTOR_CURRENT], RS_CURRENT_MIN, RS_CURRENT_BIN_WIDTH, RS_CURRENT_BINS
+    )];
+
+    if (state->sat < RS_SAT_COUNT) {
+        ++rs->sat_samples[state->sat];
+    }
+}
+
+typedef enum {
+    COMMAND_RIDE_STATS = 37,
+} RideStatsCommands;
+
+static void send_stats(const RideStats *rs) {
+    // Note: The stats are updated from the main thread while being sent here,
+    // which is racy, but the worst outcome is a slightly inconsistent snapshot.
+    static const int bufsize = 2 + 8 + 2 + RS_QUANTILE_COUNT +
+        RS_CHANNEL_COUNT * 4 * (4 + RS_QUANTILE_COUNT) + 1 + 4 * RS_DUTY_BINS + 9 +
+        4 * RS_CURRENT_BINS + 1 + 5 * RS_SAT_COUNT;
+    uint8_t buf[bufsize];
+    int32_t ind = 0;
+
+    buf[ind++] = 101;  // Package ID
+    buf[ind++] = COMMAND_RIDE_STATS;
+
+    buffer_append_float32_auto(buf, rs->duration_us * 1e-6f, &ind);
+    buffer_append_uint32(buf, rs->sample_count, &ind);
+
+    buf[ind++] = RS_CHANNEL_COUNT;
+    buf[ind++] = RS_QUANTILE_COUNT;
+    for (uint8_t i = 0; i < RS_QUANTILE_COUNT; ++i) {
+        buf[ind++] = lroundf(quantile_probabilities[i] * 100.0f);
+    }
+
+    for (uint8_t i = 0; i < RS_CHANNEL_COUNT; ++i) {
+        const RunningStats *stats = &rs->channels[i];
+        buffer_append_float32_auto(buf, stats->min, &ind);
+        buffer_append_float32_auto(buf, stats->max, &ind);
+        buffer_append_float32_auto(buf, running_stats_mean(stats), &ind);
+        buffer_append_float32_auto(buf, sqrtf(running_stats_variance(stats)), &ind);
+        for (uint8_t j = 0; j < RS_QUANTILE_COUNT; ++j) {
+            buffer_append_float32_auto(buf, p2_quantile_value(&rs->quantiles[i][j]), &ind);
+        }
+    }
+
+    buf[ind++] = RS_DUTY_BINS;
+    for (uint8_t i = 0; i < RS_DUTY_BINS; ++i) {
+        buffer_append_uint32(buf, rs->duty_histogram[i], &ind);
+    }
+
+    buf[ind++] = RS_CURRENT_BINS;
+    buffer_append_float32_auto(buf, RS_CURRENT_MIN, &ind);
+    buffer_append_float32_auto(buf, RS_CURRENT_BIN_WIDTH, &ind);
+    for (uint8_t i = 0; i < RS_CURRENT_BINS; ++i) {
+        buffer_append_uint32(buf, rs->current_histogram[i], &ind);
+    }
+
+    // only the SATs which occurred
+    int32_t sat_count_index = ind++;
+    uint8_t sat_count = 0;
+    for (uint8_t i = 0; i < RS_SAT_COUNT; ++i) {
+        if (rs->sat_samples[i] > 0) {
+            buf[ind++] = i;
+            buffer_append_uint32(buf, rs->sat_samples[i], &ind);
+            ++sat_count;
+        }
+    }
+    buf[sat_count_index] = sat_count;
+
+    SEND_APP_DATA(buf, bufsize, ind);
+}
+
+void ride_stats_request(RideStats *rs, uint8_t *buffer, size_t len) {
+    uint8_t flags = len >= 1 ? buffer[0] : 0;
+
+    send_stats(rs);
+
+    if (flags & 0x1) {
+        // reset from the main thread, which updates the stats
+        rs->reset_requested = true;
+    }
+}
@@ -0,0 +1,76 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "lib/p2_quantile.h"
+#include "lib/running_stats.h"
+#include "motor_data.h"
+#include "state.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum {
+    RS_MOTOR_CURRENT = 0,
+    RS_BATTERY_CURRENT,
+    RS_DUTY_CYCLE,
+    RS_SPEED,
+    RS_BATTERY_VOLTAGE,
+    RS_MOSFET_TEMP,
+    RS_MOTOR_TEMP,
+    RS_CHANNEL_COUNT
+} RideStatsChannel;
+
+#define RS_QUANTILE_COUNT 3
+
+#define RS_DUTY_BINS 10
+#define RS_DUTY_BIN_WIDTH 0.1f
+
+#define RS_CURRENT_BINS 20
+#define RS_CURRENT_BIN_WIDTH 10.0f
+#define RS_CURRENT_MIN -50.0f
+
+// SAT values fit under this limit, see SetpointAdjustmentType
+#define RS_SAT_COUNT 16
+
+// Statistics of the ride, updated incrementally on every control loop
+// iteration while running, in constant memory. They accumulate until reset.
+typedef struct {
+    bool reset_requested;
+
+    // total running time in microseconds, an integer so that adding the
+    // ~1ms loop periods doesn't lose precision on long rides
+    uint64_t duration_us;
+    uint32_t sample_count;
+
+    RunningStats channels[RS_CHANNEL_COUNT];
+    P2Quantile quantiles[RS_CHANNEL_COUNT][RS_QUANTILE_COUNT];
+
+    // the histograms and SAT times are in numbers of samples
+    uint32_t duty_histogram[RS_DUTY_BINS];
+    uint32_t current_histogram[RS_CURRENT_BINS];
+    uint32_t sat_samples[RS_SAT_COUNT];
+} RideStats;
+
+void ride_stats_init(RideStats *rs);
+
+void ride_stats_reset(RideStats *rs);
+
+void ride_stats_update(RideStats *rs, const State *state, const MotorData *motor, float dt);
+
+void ride_stats_request(RideStats *rs, uint8_t *buffer, size_t len);
@@ -0,0 +1,73 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include "rt_frame.h"
+
+#include "conf/buffer.h"
+
+#include <math.h>
+#include <stddef.h>
+
+void rt_frame_begin(
+    RtFrameWriter *w, uint8_t *buffer, int32_t ind, bool use_f32, float *last_values, bool keyframe
+) {
+    w->buffer = buffer;
+    w->ind = ind;
+    w->use_f32 = use_f32;
+    w->last_values = last_values;
+    w->keyframe = keyframe;
+    w->changed[0] = 0;
+    w->changed[1] = 0;
+
+    // the changed masks are filled in at the end
+    w->changed_index = ind;
+    if (last_values) {
+        w->ind += 8;
+    }
+}
+
+static void mark_changed(RtFrameWriter *w, uint8_t item) {
+    w->changed[item / 32] |= 1u << (item % 32);
+}
+
+void rt_frame_write_value(RtFrameWriter *w, uint8_t item, float value, float quantum) {
+    if (w->last_values) {
+        if (!w->keyframe && fabsf(value - w->last_values[item]) < quantum) {
+            return;
+        }
+        w->last_values[item] = value;
+        mark_changed(w, item);
+    }
+
+    if (w->use_f32) {
+        buffer_append_float32_auto(w->buffer, value, &w->ind);
+    } else {
+        buffer_append_float16_auto(w->buffer, value, &w->ind);
+    }
+}
+
+void rt_frame_mark_raw(RtFrameWriter *w, uint8_t item) {
+    mark_changed(w, item);
+}
+
+int32_t rt_frame_end(RtFrameWriter *w) {
+    if (w->last_values) {
+        buffer_append_uint32(w->buffer, w->changed[0], &w->changed_index);
+        buffer_append_uint32(w->buffer, w->changed[1], &w->changed_index);
+    }
+    return w->ind;
+}
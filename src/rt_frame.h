@@ -0,0 +1,67 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Writer of the item values of a REALTIME_DATA frame, either a full frame with
+// all the items, or a delta frame which only contains the items changed since
+// the previous frame.
+//
+// A delta frame starts with two 32-bit changed masks (indexed the same way as
+// the item masks, the second one offset by 32), followed by the values of the
+// items marked in them. The writer keeps the values last sent in a delta frame
+// in last_values, indexed by the item index.
+
+typedef struct {
+    uint8_t *buffer;
+    int32_t ind;
+    bool use_f32;
+    float *last_values;  // NULL for a full frame
+    bool keyframe;
+    int32_t changed_index;
+    uint32_t changed[2];
+} RtFrameWriter;
+
+/**
+ * Starts writing the values at buffer[ind]. If last_values is not NULL, writes
+ * a delta frame (reserving space for the changed masks), in which case a
+ * keyframe contains all the items regardless of their change.
+ */
+void rt_frame_begin(
+    RtFrameWriter *w, uint8_t *buffer, int32_t ind, bool use_f32, float *last_values, bool keyframe
+);
+
+/**
+ * Writes a float value of the item, in a delta frame only if it's a keyframe
+ * or the value changed by at least quantum since it was last sent.
+ */
+void rt_frame_write_value(RtFrameWriter *w, uint8_t item, float value, float quantum);
+
+/**
+ * Marks an item which isn't a float and is always sent. Its value is written
+ * by the caller into w->buffer at w->ind.
+ */
+void rt_frame_mark_raw(RtFrameWriter *w, uint8_t item);
+
+/**
+ * Finishes the frame by filling in the changed masks of a delta frame. Returns
+ * the index past the end of the frame.
+ */
+int32_t rt_frame_end(RtFrameWriter *w);
@@ -0,0 +1,242 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include "tune_profiles.h"
+
+#include "conf/buffer.h"
+#include "lib/utils.h"
+
+#include <string.h>
+
+#define TUNE_PROFILE_WORDS ((sizeof(TuneProfile) - 1) / 4 + 1)
+#define TUNE_PROFILE_MAGIC 0x5450u
+
+// the field names, the layout word holds their CRC to detect profiles stored
+// by a version with different fields
+#define TUNE_PROFILE_FIELD(name) #name ","
+static const char field_names[] = TUNE_PROFILE_FIELDS(TUNE_PROFILE_FIELD);
+#undef TUNE_PROFILE_FIELD
+
+static uint32_t header_word(const TuneProfile *profile) {
+    return TUNE_PROFILE_MAGIC << 16 | crc16((const uint8_t *) profile, sizeof(TuneProfile));
+}
+
+static uint32_t layout_word() {
+    return sizeof(TuneProfile) << 16 | crc16((const uint8_t *) field_names, sizeof(field_names));
+}
+
+static uint32_t slot_address(const TuneProfiles *tp, uint8_t slot) {
+    return tp->eeprom_address + slot * (2 + TUNE_PROFILE_WORDS);
+}
+
+// The profile is copied by words from and to the EEPROM directly, without a
+// buffer, the aux thread stack is small.
+static size_t word_size(uint32_t i) {
+    return min(sizeof(TuneProfile) - i * 4, 4u);
+}
+
+static bool load(TuneProfiles *tp, uint8_t slot) {
+    uint32_t address = slot_address(tp, slot);
+    uint8_t *profile = (uint8_t *) &tp->profiles[slot];
+    eeprom_var v;
+
+    if (!VESC_IF->read_eeprom_var(&v, address) || v.as_u32 >> 16 != TUNE_PROFILE_MAGIC) {
+        return false;
+    }
+    uint32_t header = v.as_u32;
+
+    if (!VESC_IF->read_eeprom_var(&v, address + 1)) {
+        return false;
+    }
+    if (v.as_u32 != layout_word()) {
+        log_error("Tune profile %u stored with a different layout, discarded.", slot);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < TUNE_PROFILE_WORDS; ++i) {
+        if (!VESC_IF->read_eeprom_var(&v, address + 2 + i)) {
+            return false;
+        }
+        memcpy(&profile[i * 4], &v.as_u32, word_size(i));
+    }
+
+    if (header_word(&tp->profiles[slot]) != header) {
+        log_error("Tune profile %u CRC mismatch.", slot);
+        return false;
+    }
+    return true;
+}
+
+static bool store(const TuneProfiles *tp, uint8_t slot) {
+    uint32_t address = slot_address(tp, slot);
+    const uint8_t *profile = (const uint8_t *) &tp->profiles[slot];
+
+    eeprom_var v = {.as_u32 = layout_word()};
+    if (!VESC_IF->store_eeprom_var(&v, address + 1)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < TUNE_PROFILE_WORDS; ++i) {
+        v.as_u32 = 0;
+        memcpy(&v.as_u32, &profile[i * 4], word_size(i));
+        if (!VESC_IF->store_eeprom_var(&v, address + 2 + i)) {
+            return false;
+        }
+    }
+
+    // the header last, an incomplete write fails the CRC check
+    v.as_u32 = header_word(&tp->profiles[slot]);
+    return VESC_IF->store_eeprom_var(&v, address);
+}
+
+static bool clear(const TuneProfiles *tp, uint8_t slot) {
+    eeprom_var v = {.as_u32 = 0};
+    return VESC_IF->store_eeprom_var(&v, slot_address(tp, slot));
+}
+
+static void capture(TuneProfile *profile, const RefloatConfig *cfg) {
+#define TUNE_PROFILE_FIELD(name) profile->name = cfg->name;
+    TUNE_PROFILE_FIELDS(TUNE_PROFILE_FIELD)
+#undef TUNE_PROFILE_FIELD
+}
+
+static void apply(const TuneProfile *profile, RefloatConfig *cfg) {
+#define TUNE_PROFILE_FIELD(name) cfg->name = profile->name;
+    TUNE_PROFILE_FIELDS(TUNE_PROFILE_FIELD)
+#undef TUNE_PROFILE_FIELD
+}
+
+void tune_profiles_init(TuneProfiles *tp, uint32_t eeprom_address) {
+    tp->eeprom_address = eeprom_address;
+    tp->valid_mask = 0;
+    tp->active = -1;
+    tp->pending = -1;
+    tp->applied = false;
+
+    for (uint8_t i = 0; i < TUNE_PROFILE_COUNT; ++i) {
+        if (load(tp, i)) {
+            tp->valid_mask |= 1 << i;
+        }
+    }
+}
+
+uint32_t tune_profiles_eeprom_end(const TuneProfiles *tp) {
+    return slot_address(tp, TUNE_PROFILE_COUNT);
+}
+
+void tune_profiles_apply_pending(TuneProfiles *tp, RefloatConfig *cfg) {
+    int8_t slot = __atomic_load_n(&tp->pending, __ATOMIC_ACQUIRE);
+    if (slot < 0) {
+        return;
+    }
+
+    apply(&tp->profiles[slot], cfg);
+    tp->active = slot;
+    __atomic_store_n(&tp->pending, -1, __ATOMIC_RELEASE);
+    __atomic_store_n(&tp->applied, true, __ATOMIC_RELEASE);
+}
+
+void tune_profiles_wait_applied(const TuneProfiles *tp) {
+    // the main thread applies it in its next iteration, the limit only guards
+    // against it not running anymore, in which case it can't be applying it
+    for (uint16_t i = 0; i < 1000 && __atomic_load_n(&tp->pending, __ATOMIC_ACQUIRE) >= 0; ++i) {
+        VESC_IF->sleep_us(100);
+    }
+}
+
+bool tune_profiles_take_applied(TuneProfiles *tp) {
+    return __atomic_exchange_n(&tp->applied, false, __ATOMIC_ACQ_REL);
+}
+
+typedef enum {
+    COMMAND_TUNE_PROFILES = 40,
+} TuneProfilesCommands;
+
+typedef enum {
+    TP_MODE_INFO = 0,
+    TP_MODE_SWITCH = 1,
+    TP_MODE_STORE = 2,
+    TP_MODE_CLEAR = 3,
+} TuneProfilesMode;
+
+static void send_info(const TuneProfiles *tp, bool ok) {
+    static const int bufsize = 7;
+    uint8_t buf[bufsize];
+    int32_t ind = 0;
+
+    buf[ind++] = 101;  // Package ID
+    buf[ind++] = COMMAND_TUNE_PROFILES;
+    buf[ind++] = ok;
+    buf[ind++] = TUNE_PROFILE_COUNT;
+    buf[ind++] = tp->valid_mask;
+    // a switch requested just now is not applied yet
+    int8_t pending = __atomic_load_n(&tp->pending, __ATOMIC_ACQUIRE);
+    buf[ind++] = pending >= 0 ? pending : tp->active;
+    buf[ind++] = sizeof(TuneProfile) <= 255 ? sizeof(TuneProfile) : 255;
+
+    // runs in the aux thread as a queued command
+    SEND_APP_DATA_DIRECT(buf, bufsize, ind);
+}
+
+void tune_profiles_request(
+    TuneProfiles *tp, const RefloatConfig *cfg, uint8_t *buffer, size_t len
+) {
+    uint8_t mode = len > 0 ? buffer[0] : TP_MODE_INFO;
+    uint8_t slot = len > 1 ? buffer[1] : 0;
+
+    if (mode != TP_MODE_INFO && (len < 2 || slot >= TUNE_PROFILE_COUNT)) {
+        log_error("Tune profiles: Invalid slot or command length.");
+        send_info(tp, false);
+        return;
+    }
+
+    bool ok = true;
+    switch (mode) {
+    case TP_MODE_INFO:
+        break;
+    case TP_MODE_SWITCH:
+        if (tp->valid_mask & (1 << slot)) {
+            __atomic_store_n(&tp->pending, slot, __ATOMIC_RELEASE);
+        } else {
+            log_error("Tune profiles: Slot %u is empty.", slot);
+            ok = false;
+        }
+        break;
+    case TP_MODE_STORE:
+        capture(&tp->profiles[slot], cfg);
+        ok = store(tp, slot);
+        if (ok) {
+            tp->valid_mask |= 1 << slot;
+        } else {
+            log_error("Tune profiles: Failed to store slot %u.", slot);
+            tp->valid_mask &= ~(1 << slot);
+        }
+        break;
+    case TP_MODE_CLEAR:
+        ok = clear(tp, slot);
+        tp->valid_mask &= ~(1 << slot);
+        if (tp->active == slot) {
+            tp->active = -1;
+        }
+        break;
+    default:
+        log_error("Tune profiles: Unknown mode %u.", mode);
+        ok = false;
+    }
+
+    send_info(tp, ok);
+}
@@ -0,0 +1,129 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "conf/datatypes.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TUNE_PROFILE_COUNT 3
+
+// The tune-relevant subset of RefloatConfig stored in a profile.
+#define TUNE_PROFILE_FIELDS(X)                                                                     \
+    X(kp)                                                                                          \
+    X(ki)                                                                                          \
+    X(kp2)                                                                                         \
+    X(mahony_kp)                                                                                   \
+    X(mahony_kp_roll)                                                                              \
+    X(kp_brake)                                                                                    \
+    X(kp2_brake)                                                                                   \
+    X(ki_limit)                                                                                    \
+    X(tiltback_constant)                                                                           \
+    X(tiltback_constant_erpm)                                                                      \
+    X(tiltback_variable)                                                                           \
+    X(tiltback_variable_max)                                                                       \
+    X(tiltback_variable_erpm)                                                                      \
+    X(noseangling_speed)                                                                           \
+    X(booster_angle)                                                                               \
+    X(booster_ramp)                                                                                \
+    X(booster_current)                                                                             \
+    X(brkbooster_angle)                                                                            \
+    X(brkbooster_ramp)                                                                             \
+    X(brkbooster_current)                                                                          \
+    X(torquetilt_start_current)                                                                    \
+    X(torquetilt_angle_limit)                                                                      \
+    X(torquetilt_strength)                                                                         \
+    X(torquetilt_strength_regen)                                                                   \
+    X(atr_strength_up)                                                                             \
+    X(atr_strength_down)                                                                           \
+    X(atr_threshold_up)                                                                            \
+    X(atr_threshold_down)                                                                          \
+    X(atr_speed_boost)                                                                             \
+    X(atr_angle_limit)                                                                             \
+    X(atr_filter)                                                                                  \
+    X(atr_amps_accel_ratio)                                                                        \
+    X(atr_amps_decel_ratio)                                                                        \
+    X(braketilt_strength)                                                                          \
+    X(braketilt_lingering)                                                                         \
+    X(turntilt_strength)                                                                           \
+    X(turntilt_angle_limit)                                                                        \
+    X(turntilt_start_angle)                                                                        \
+    X(turntilt_start_erpm)                                                                         \
+    X(turntilt_erpm_boost)                                                                         \
+    X(turntilt_erpm_boost_end)                                                                     \
+    X(turntilt_yaw_aggregate)                                                                      \
+    X(torque_tilt)                                                                                 \
+    X(atr)                                                                                         \
+    X(turn_tilt)
+
+typedef struct {
+#define TUNE_PROFILE_FIELD(name) __typeof__(((RefloatConfig *) 0)->name) name;
+    TUNE_PROFILE_FIELDS(TUNE_PROFILE_FIELD)
+#undef TUNE_PROFILE_FIELD
+} TuneProfile;
+
+// Tune profiles stored in the EEPROM, each slot at eeprom_address +
+// slot * (2 + TUNE_PROFILE_WORDS) as a header word (a magic number and a CRC),
+// a layout word (the size of TuneProfile and a CRC of its field names, a
+// profile with a different layout is discarded) and the raw TuneProfile.
+//
+// The profiles are kept deserialized in memory. Switching is requested from
+// the aux thread (where the config-changing commands run) and the profile is
+// applied by the main thread in between control loop iterations, so that the
+// control loop never runs with a partially switched tune. Before running the
+// next queued command the aux thread waits for the switch to be applied, so
+// the config is never saved or modified while it's being switched.
+typedef struct {
+    uint32_t eeprom_address;
+    TuneProfile profiles[TUNE_PROFILE_COUNT];
+    uint8_t valid_mask;
+    int8_t active;  // the last applied slot, -1 if none since the config was loaded
+
+    int8_t pending;  // the slot to be applied by the main thread, -1 if none, atomic
+    bool applied;  // set by the main thread after applying a slot, atomic
+} TuneProfiles;
+
+void tune_profiles_init(TuneProfiles *tp, uint32_t eeprom_address);
+
+/**
+ * Returns the EEPROM address following the profile slots.
+ */
+uint32_t tune_profiles_eeprom_end(const TuneProfiles *tp);
+
+/**
+ * Called from the main thread, applies a pending profile switch to the config.
+ */
+void tune_profiles_apply_pending(TuneProfiles *tp, RefloatConfig *cfg);
+
+/**
+ * Called from the aux thread, waits for a pending profile switch to be applied
+ * by the main thread. Only the aux thread requests switches, so none can start
+ * afterwards until the next request.
+ */
+void tune_profiles_wait_applied(const TuneProfiles *tp);
+
+/**
+ * Returns true once after a profile has been applied by the main thread.
+ */
+bool tune_profiles_take_applied(TuneProfiles *tp);
+
+void tune_profiles_request(
+    TuneProfiles *tp, const RefloatConfig *cfg, uint8_t *buffer, size_t len
+);
@@ -0,0 +1,78 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include "test.h"
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+int test_failures = 0;
+
+static int host_printf(const char *str, ...) {
+    va_list args;
+    va_start(args, str);
+    int ret = vprintf(str, args);
+    va_end(args);
+    printf("\n");
+    return ret;
+}
+
+static float host_system_time() {
+    return 0.0f;
+}
+
+static bool host_app_is_output_disabled() {
+    return false;
+}
+
+static void host_sleep_us(uint32_t us) {
+    (void) us;
+}
+
+vesc_c_if host_vesc_if = {
+    .printf = host_printf,
+    .malloc = malloc,
+    .free = free,
+    .system_time = host_system_time,
+    .app_is_output_disabled = host_app_is_output_disabled,
+    .sleep_us = host_sleep_us,
+};
+
+int test_result(const char *name) {
+    if (test_failures > 0) {
+        printf("%s: FAILED (%d failed checks)\n", name, test_failures);
+        return 1;
+    }
+
+    printf("%s: OK\n", name);
+    return 0;
+}
+
+float from_float16(uint16_t h) {
+    int exponent = (h >> 10) & 0x1f;
+    int mantissa = h & 0x3ff;
+    // no infinities and NaNs in the alternative format, exponent 31 is normal
+    float value = exponent == 0 ? ldexpf(mantissa, -24) : ldexpf(1024 + mantissa, exponent - 25);
+    return h & 0x8000 ? -value : value;
+}
+
+float test_random() {
+    static uint32_t state = 12345;
+    state = state * 1664525 + 1013904223;
+    return (state >> 8) / 16777216.0f;
+}
@@ -0,0 +1,28 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+// Force-included into all sources built for the host tests. Replaces the VESC
+// interface, which is at a fixed address in the firmware, by a host stub.
+
+#include "vesc_c_if.h"
+
+#undef VESC_IF
+#define VESC_IF (&host_vesc_if)
+
+extern vesc_c_if host_vesc_if;
@@ -0,0 +1,48 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdio.h>
+
+extern int test_failures;
+
+#define CHECK(cond, ...)                                                                           \
+    do {                                                                                           \
+        if (!(cond)) {                                                                             \
+            ++test_failures;                                                                       \
+            printf("%s:%d: check failed: %s: ", __FILE__, __LINE__, #cond);                        \
+            printf(__VA_ARGS__);                                                                   \
+            printf("\n");                                                                          \
+        }                                                                                          \
+    } while (0)
+
+/**
+ * Prints the result of the test, returns the exit code of the test program.
+ */
+int test_result(const char *name);
+
+/**
+ * Decodes a float16 in the ARM alternative half-precision format, which is
+ * what to_float16() encodes to.
+ */
+float from_float16(uint16_t h);
+
+/**
+ * A deterministic pseudo-random number generator, returns a number in [0, 1).
+ */
+float test_random();
@@ -0,0 +1,135 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+// Checks the float16 conversion against a model of the VCVTB instruction in
+// the ARM alternative half-precision format (FPSCR.AHP set, FPSCR.FZ clear)
+// over all float32 exponents.
+//
+// On the host, to_float16() is the software conversion. Built for an ARM
+// target with the half-precision extension (FLOAT16_HW), to_float16() is the
+// hardware conversion and is checked to match the model exactly.
+
+#include "test.h"
+
+#include "conf/buffer.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+// Model of FPSingleToHalf() of the ARM architecture reference manual with
+// alternative half-precision and round to nearest even. Sets tie if the value
+// was exactly halfway between two float16 values.
+static uint16_t model_vcvtb_ahp(uint32_t bits, bool *tie) {
+    uint16_t sign = (bits >> 16) & 0x8000;
+    int exponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+    *tie = false;
+
+    if (exponent == 0xff) {
+        // NaN converts to zero, infinity saturates
+        return mantissa != 0 ? 0 : sign | 0x7fff;
+    }
+    if (exponent == 0) {
+        // float32 zero or subnormal, the subnormals are way below the float16 range
+        return sign;
+    }
+
+    // value = significand * 2^(e - 23)
+    int e = exponent - 127;
+    uint32_t significand = mantissa | 0x800000;
+
+    // shift to the unit of the float16 mantissa: 2^(e - 10) for normal
+    // numbers, 2^-24 for subnormals
+    int shift = e >= -14 ? 13 : 13 - 14 - e;
+    if (shift > 25) {
+        return sign;
+    }
+
+    uint32_t q = significand >> shift;
+    uint32_t rem = significand & ((1u << shift) - 1);
+    uint32_t half = 1u << (shift - 1);
+    *tie = rem == half;
+    if (rem > half || (rem == half && (q & 1))) {
+        ++q;
+    }
+
+    if (e < -14) {
+        // a subnormal, rounding up to 0x400 makes it the smallest normal number
+        return sign | q;
+    }
+
+    if (q == 0x800) {
+        q = 0x400;
+        ++e;
+    }
+    if (e + 15 > 31) {
+        return sign | 0x7fff;
+    }
+    return sign | (uint16_t) (e + 15) << 10 | (q - 0x400);
+}
+
+static uint32_t ties_differing = 0;
+static uint32_t nans_differing = 0;
+
+static void check(uint32_t bits) {
+    float x;
+    memcpy(&x, &bits, sizeof(x));
+
+    bool tie;
+    uint16_t expected = model_vcvtb_ahp(bits, &tie);
+    uint16_t sw = to_float16_sw(x);
+    bool nan = (bits & 0x7fffffff) > 0x7f800000;
+
+    // the software conversion rounds ties away from zero and converts NaN to
+    // the maximum, otherwise it matches the hardware
+    if (sw != expected) {
+        if (tie && sw == expected + 1) {
+            ++ties_differing;
+        } else if (nan) {
+            ++nans_differing;
+        } else {
+            CHECK(false, "to_float16_sw(0x%08x): 0x%04x, expected 0x%04x", bits, sw, expected);
+        }
+    }
+
+#ifdef FLOAT16_HW
+    uint16_t hw = to_float16(x);
+    CHECK(hw == expected, "to_float16(0x%08x): 0x%04x, expected 0x%04x", bits, hw, expected);
+#endif
+}
+
+int main() {
+    for (uint32_t sign = 0; sign < 2; ++sign) {
+        for (uint32_t exponent = 0; exponent < 256 && test_failures < 20; ++exponent) {
+            // all mantissas for the exponents which don't just convert to zero
+            // or saturate, a sample of them for the rest
+            uint32_t step = exponent >= 100 && exponent <= 144 ? 1 : 4093;
+            uint32_t base = sign << 31 | exponent << 23;
+            for (uint32_t mantissa = 0; mantissa < 0x800000; mantissa += step) {
+                check(base | mantissa);
+            }
+            check(base | 0x7fffff);
+        }
+    }
+
+    printf(
+        "float16: software conversion differs in %u ties and %u NaNs\n",
+        ties_differing,
+        nans_differing
+    );
+    return test_result("float16");
+}
@@ -0,0 +1,143 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+// Checks the fixed point color math against the same math in floating point,
+// rounded to the nearest integer. The results may differ by at most 1, due to
+// the 1/256 resolution of the factors.
+
+#include "test.h"
+
+#include "led_color.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#define BLENDS_PER_PAIR 16
+
+static uint8_t channel(uint32_t color, int ch) {
+    return color >> (8 * ch);
+}
+
+// Each channel of the two colors gets a different value pair, so that all
+// pairs are covered on all channels when iterating over c1 and c2.
+static uint32_t make_color(uint8_t c, uint8_t step) {
+    uint32_t color = 0;
+    for (int ch = 0; ch < 4; ++ch) {
+        color |= (uint32_t) ((c + step * ch) & 0xff) << (8 * ch);
+    }
+    return color;
+}
+
+static void check_mix(
+    uint32_t result, uint32_t color1, double k1, uint32_t color2, double k2, const char *what
+) {
+    for (int ch = 0; ch < 4; ++ch) {
+        double exact = channel(color1, ch) * k1 + channel(color2, ch) * k2;
+        int expected = (int) floor(exact + (double) 0.5);
+        int diff = abs(channel(result, ch) - expected);
+        CHECK(
+            diff <= 1,
+            "%s: %08x * %f + %08x * %f: channel %d is %u, expected %d",
+            what,
+            color1,
+            k1,
+            color2,
+            k2,
+            ch,
+            channel(result, ch),
+            expected
+        );
+    }
+}
+
+static void test_to_q8() {
+    for (int i = -256; i <= 2 * 256 * 256; ++i) {
+        float x = i / (256.0f * 256.0f);
+        double expected = fmin(fmax(x, (double) 0.0), (double) 1.0) * Q8_ONE;
+        double diff = fabs(to_q8(x) - expected);
+        CHECK(diff <= (double) 0.5, "to_q8(%f) is %u, expected %f", x, to_q8(x), expected);
+    }
+}
+
+static void test_color_mix_exact() {
+    // with the factors given in fixed point the mix is exact up to the rounding
+    for (uint32_t c1 = 0; c1 < 256; ++c1) {
+        for (uint32_t c2 = 0; c2 < 256; ++c2) {
+            uint32_t color1 = make_color(c1, 85);
+            uint32_t color2 = make_color(c2, 51);
+            uint16_t k1 = test_random() * (Q8_ONE + 1);
+            uint16_t k2 = test_random() * (Q8_ONE + 1 - k1);
+            uint32_t result = color_mix(color1, k1, color2, k2);
+
+            for (int ch = 0; ch < 4; ++ch) {
+                uint32_t expected =
+                    (channel(color1, ch) * k1 + channel(color2, ch) * k2 + Q8_ONE / 2) / Q8_ONE;
+                CHECK(
+                    channel(result, ch) == expected,
+                    "color_mix(%08x, %u, %08x, %u): channel %d is %u, expected %u",
+                    color1,
+                    k1,
+                    color2,
+                    k2,
+                    ch,
+                    channel(result, ch),
+                    expected
+                );
+            }
+        }
+    }
+}
+
+static void test_color_blend() {
+    for (uint32_t c1 = 0; c1 < 256; ++c1) {
+        for (uint32_t c2 = 0; c2 < 256; ++c2) {
+            uint32_t color1 = make_color(c1, 85);
+            uint32_t color2 = make_color(c2, 51);
+            for (int i = 0; i < BLENDS_PER_PAIR; ++i) {
+                float blend = test_random();
+                uint32_t result = color_blend(color1, color2, to_q8(blend));
+                check_mix(result, color1, 1.0 - blend, color2, blend, "color_blend");
+            }
+        }
+    }
+}
+
+// Writing an LED: the new color scaled by brightness * blend, mixed with the
+// current color scaled by 1 - blend, with the factors rounded separately.
+static void test_led_write() {
+    for (uint32_t c1 = 0; c1 < 256; ++c1) {
+        for (uint32_t c2 = 0; c2 < 256; ++c2) {
+            uint32_t color = make_color(c1, 85);
+            uint32_t orig = make_color(c2, 51);
+            for (int i = 0; i < BLENDS_PER_PAIR; ++i) {
+                float brightness = test_random();
+                float blend = test_random();
+                uint32_t result =
+                    color_mix(color, to_q8(brightness * blend), orig, Q8_ONE - to_q8(blend));
+                check_mix(result, color, (double) brightness * blend, orig, 1.0 - blend, "led");
+            }
+        }
+    }
+}
+
+int main() {
+    test_to_q8();
+    test_color_mix_exact();
+    test_color_blend();
+    test_led_write();
+    return test_result("led_color");
+}
@@ -0,0 +1,177 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+// Checks the table-driven LED encoder against a bit-by-bit reference encoder
+// (and the gamma table against its formula), and compares their speed.
+
+#include "test.h"
+
+// the encoder is internal to the driver
+#include "led_driver.c"
+
+#include <sys/time.h>
+
+#define LED_COUNT 512
+#define BENCHMARK_FRAMES 200
+
+static uint32_t colors[STRIP_COUNT][LED_COUNT];
+static LedStrip strips[STRIP_COUNT];
+
+// Encodes the whole frame of an output bit by bit, returns the number of bits.
+static uint32_t reference_encode(const LedDriver *driver, const LedOutput *out, uint16_t *bits) {
+    uint32_t n = 0;
+    for (uint8_t i = 0; i < out->strip_count; ++i) {
+        uint8_t strip_i = out->strips[i];
+        const StripEncoding *enc = &driver->strip_encodings[strip_i];
+        for (uint16_t led = 0; led < driver->strips[strip_i]->length; ++led) {
+            for (uint8_t ch = 0; ch < enc->channels; ++ch) {
+                uint32_t c = (driver->strip_colors[strip_i][led] >> enc->shifts[ch]) & 0xff;
+                c = (c * c + c) / 256;
+                for (int bit = 7; bit >= 0; --bit) {
+                    bits[n++] = (c >> bit) & 0x1 ? WS2812_ONE : WS2812_ZERO;
+                }
+            }
+        }
+    }
+    return n;
+}
+
+// Encodes the whole frame of an output by halves like send_frame() does,
+// returns the number of halves.
+static uint32_t encode(const LedDriver *driver, const LedOutput *out, uint16_t *bits) {
+    uint16_t buffer[BUFFER_BITS];
+    LedOutput output = *out;
+    output.buffer = buffer;
+
+    Stream s = {.output = &output};
+    uint32_t halves = 0;
+    while (s.end_halves < 2) {
+        uint8_t half = s.next_half;
+        fill_half(driver, &s);
+        memcpy(bits, buffer + half * HALF_BUFFER_BITS, HALF_BUFFER_BITS * sizeof(uint16_t));
+        bits += HALF_BUFFER_BITS;
+        ++halves;
+    }
+    return halves;
+}
+
+static void setup(LedDriver *driver, const uint16_t *lengths, const LedColorOrder *orders) {
+    memset(driver, 0, sizeof(LedDriver));
+
+    // all strips chained on a single output
+    LedOutput *out = &driver->outputs[0];
+    driver->output_count = 1;
+    for (uint8_t i = 0; i < STRIP_COUNT; ++i) {
+        strips[i].length = lengths[i];
+        strips[i].color_order = orders[i];
+        driver->strips[i] = &strips[i];
+        driver->strip_colors[i] = colors[i];
+        set_channel_shifts(&driver->strip_encodings[i], orders[i]);
+        out->strips[out->strip_count++] = i;
+
+        for (uint16_t j = 0; j < LED_COUNT; ++j) {
+            colors[i][j] = test_random() * 4294967296.0;
+        }
+    }
+}
+
+static void test_encoding() {
+    static const uint16_t lengths[][STRIP_COUNT] = {
+        {1, 1, 1},
+        {16, 1, 7},
+        {LED_COUNT, 3, 100},
+        {LED_COUNT, LED_COUNT, LED_COUNT},
+    };
+    static const LedColorOrder orders[][STRIP_COUNT] = {
+        {LED_COLOR_GRB, LED_COLOR_GRBW, LED_COLOR_RGB},
+        {LED_COLOR_WRGB, LED_COLOR_GRB, LED_COLOR_GRBW},
+        {LED_COLOR_GRBW, LED_COLOR_WRGB, LED_COLOR_GRB},
+        {LED_COLOR_RGB, LED_COLOR_RGB, LED_COLOR_GRBW},
+    };
+
+    static uint16_t expected[STRIP_COUNT * LED_COUNT * 32 + 3 * HALF_BUFFER_BITS];
+    static uint16_t actual[STRIP_COUNT * LED_COUNT * 32 + 3 * HALF_BUFFER_BITS];
+
+    for (size_t t = 0; t < sizeof(lengths) / sizeof(lengths[0]); ++t) {
+        LedDriver driver;
+        setup(&driver, lengths[t], orders[t]);
+
+        memset(expected, 0, sizeof(expected));
+        uint32_t bits = reference_encode(&driver, &driver.outputs[0], expected);
+        uint32_t halves = encode(&driver, &driver.outputs[0], actual);
+
+        // the data is followed by zeros until the end of the half and one
+        // more half of zeros
+        uint32_t expected_halves = (bits + HALF_BUFFER_BITS - 1) / HALF_BUFFER_BITS + 1;
+        CHECK(
+            halves == expected_halves,
+            "case %zu: %u halves, expected %u",
+            t,
+            halves,
+            expected_halves
+        );
+
+        for (uint32_t i = 0; i < halves * HALF_BUFFER_BITS; ++i) {
+            if (actual[i] != expected[i]) {
+                CHECK(false, "case %zu: bit %u: %u, expected %u", t, i, actual[i], expected[i]);
+                break;
+            }
+        }
+    }
+}
+
+static double seconds() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1000000;
+}
+
+static void benchmark() {
+    static const uint16_t lengths[STRIP_COUNT] = {LED_COUNT, LED_COUNT, LED_COUNT};
+    static const LedColorOrder orders[STRIP_COUNT] = {
+        LED_COLOR_GRBW, LED_COLOR_GRBW, LED_COLOR_GRBW
+    };
+    static uint16_t bits[STRIP_COUNT * LED_COUNT * 32 + 3 * HALF_BUFFER_BITS];
+
+    LedDriver driver;
+    setup(&driver, lengths, orders);
+
+    double start = seconds();
+    for (uint32_t i = 0; i < BENCHMARK_FRAMES; ++i) {
+        reference_encode(&driver, &driver.outputs[0], bits);
+    }
+    double reference_time = seconds() - start;
+
+    start = seconds();
+    for (uint32_t i = 0; i < BENCHMARK_FRAMES; ++i) {
+        encode(&driver, &driver.outputs[0], bits);
+    }
+    double table_time = seconds() - start;
+
+    uint32_t leds = BENCHMARK_FRAMES * STRIP_COUNT * LED_COUNT;
+    printf(
+        "led_encoder: GRBW LED encoded in %.1f ns (bit by bit: %.1f ns) on the host\n",
+        table_time / leds * 1e9,
+        reference_time / leds * 1e9
+    );
+}
+
+int main() {
+    test_encoding();
+    benchmark();
+    return test_result("led_encoder");
+}
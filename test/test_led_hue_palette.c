@@ -0,0 +1,99 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+// Checks the hue palette against hue_to_color(), the float computation the
+// palette was generated with. To regenerate the palette, e.g. after changing
+// the hue curve, run the test with --print and paste the output into
+// src/led_hue_palette.h.
+
+#include "test.h"
+
+#include "led_hue_palette.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bhaskara cosine approximation, a copy of cosine_progress() in leds.c.
+static float cosine_progress(float time) {
+    uint32_t rounded = lroundf(time);
+    float x = (time - rounded) * M_PI;
+    x *= x;
+    float cos = 2.5f * x / (x + M_PI * M_PI);
+    if (rounded % 2 == 1) {
+        return 1 - cos;
+    } else {
+        return cos;
+    }
+}
+
+// Tweaks the color channel value to make the hue more uniform.
+static float tweak_color(float x, float a) {
+    if (x < 1.0f) {
+        return 1.0f - powf(1.0f - x, a);
+    } else if (x < 2.0f) {
+        return 1.0f + powf(x - 1.0f, a);
+    }
+    return 0.0f;
+}
+
+// Returns color for hue in range [0..255].
+static uint32_t hue_to_color(uint8_t hue) {
+    float norm = (float) hue / 255.0f * 3.0f;
+    float r_norm = fmodf(norm + 0.5f, 3.0f);
+    float g_norm = fmodf(norm + 2.5f, 3.0f);
+    float b_norm = fmodf(norm + 1.5f, 3.0f);
+    float r = cosine_progress(tweak_color(r_norm, 3.2f));
+    float g = cosine_progress(tweak_color(g_norm, 2.4f));
+    float b = cosine_progress(tweak_color(b_norm, 2.2f));
+
+    return ((uint8_t) (r * 255) << 16) | ((uint8_t) (g * 255) << 8) | (uint8_t) (b * 255);
+}
+
+static void print_palette() {
+    for (int i = 0; i < 256; ++i) {
+        printf("%s0x%06x,%s", i % 8 == 0 ? "    " : " ", hue_to_color(i), i % 8 == 7 ? "\n" : "");
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "--print") == 0) {
+        print_palette();
+        return 0;
+    }
+
+    CHECK(sizeof(hue_palette) / sizeof(hue_palette[0]) == 256, "the palette has 256 entries");
+
+    // the float math of the target may round differently
+    for (int hue = 0; hue < 256; ++hue) {
+        uint32_t expected = hue_to_color(hue);
+        CHECK(hue_palette[hue] >> 24 == 0, "hue %d: %08x has white", hue, hue_palette[hue]);
+        for (int shift = 0; shift < 24; shift += 8) {
+            int channel = (hue_palette[hue] >> shift) & 0xff;
+            int expected_channel = (expected >> shift) & 0xff;
+            CHECK(
+                abs(channel - expected_channel) <= 1,
+                "hue %d: %06x, expected %06x",
+                hue,
+                hue_palette[hue],
+                expected
+            );
+        }
+    }
+
+    return test_result("led_hue_palette");
+}
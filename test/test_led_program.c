@@ -0,0 +1,285 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+// Checks the LED program validator rejects every program which could access
+// anything out of bounds when it runs, and the results of all opcodes.
+
+#include "test.h"
+
+// the validator and the evaluation are static
+#include "led_program.c"
+
+#include "led_hue_palette.h"
+
+#include <math.h>
+#include <stdarg.h>
+
+#define Q(x) ((int32_t) ((x) * 65536))
+// a CONST instruction with a Q8.8 operand
+#define C(x) LP_OP_CONST, (uint8_t) ((int16_t) ((x) * 256) >> 8), (uint8_t) ((int16_t) ((x) * 256))
+
+#define CODE(...) ((const uint8_t[]) {__VA_ARGS__}), sizeof((const uint8_t[]) {__VA_ARGS__})
+
+static char last_message[256];
+
+static int capture_printf(const char *str, ...) {
+    va_list args;
+    va_start(args, str);
+    int ret = vsnprintf(last_message, sizeof(last_message), str, args);
+    va_end(args);
+    return ret;
+}
+
+// distinct colors, filled in main()
+static uint32_t palette[LED_PROGRAM_PALETTE_SIZE];
+
+static const LedProgramContext ctx = {
+    .time = Q(12.5),
+    .length = Q(20),
+    .pos_step = Q(1) / 20,
+    .speed = Q(-3.25),
+    .duty = Q(0.75),
+    .pitch = Q(7.5),
+    .color1 = 0x102030,
+    .color2 = 0xF0E0D0,
+    .palette = palette,
+    .hue_palette = hue_palette,
+};
+
+// Loads the program, if it's rejected, checks the error message contains
+// `error`.
+static bool check_load(
+    LedProgram *program, const uint8_t *code, uint8_t length, bool valid, const char *error
+) {
+    last_message[0] = '\0';
+    bool ok = program_load(program, code, length);
+    CHECK(ok == valid, "program of length %u %s", length, valid ? "rejected" : "accepted");
+    if (!ok && !valid) {
+        CHECK(strstr(last_message, error), "expected \"%s\" in: %s", error, last_message);
+    }
+    return ok;
+}
+
+#define VALID(...) check_load(&program, CODE(__VA_ARGS__), true, NULL)
+#define INVALID(error, ...) check_load(&program, CODE(__VA_ARGS__), false, error)
+
+static void test_validator() {
+    LedProgram program = {0};
+
+    VALID(LP_OP_COLOR1);
+    CHECK(program.length == 1 && !program.dynamic, "COLOR1 loaded");
+
+    // a failed load leaves the program as it was
+    INVALID("Invalid opcode", LP_OP_COLOR2, 0x00);
+    CHECK(program.length == 1 && program.code[0] == LP_OP_COLOR1, "failed load kept the program");
+
+    INVALID("Invalid opcode", 0x00);
+    INVALID("Invalid opcode", 0x09);
+    INVALID("Invalid opcode", LP_OP_SCALE + 1);
+    INVALID("Invalid opcode", 0xFF);
+
+    // operands
+    VALID(C(1.5));
+    INVALID("Missing operand", LP_OP_CONST);
+    INVALID("Missing operand", LP_OP_CONST, 0x01);
+    INVALID("Missing operand", LP_OP_COLOR1, LP_OP_PALETTE);
+    VALID(LP_OP_PALETTE, LED_PROGRAM_PALETTE_SIZE - 1);
+    INVALID("Invalid palette index", LP_OP_PALETTE, LED_PROGRAM_PALETTE_SIZE);
+    INVALID("Invalid palette index", LP_OP_PALETTE, 0xFF);
+    // an operand byte which is a valid opcode isn't executed
+    VALID(LP_OP_CONST, LP_OP_ADD, LP_OP_ADD);
+
+    // stack underflow
+    INVALID("underflow", LP_OP_ADD);
+    INVALID("underflow", LP_OP_DROP, LP_OP_COLOR1);
+    INVALID("underflow", LP_OP_COLOR1, LP_OP_SWAP);
+    INVALID("underflow", LP_OP_COLOR1, LP_OP_COLOR2, LP_OP_MIX);
+    INVALID("underflow", C(1), C(1), LP_OP_SELECT);
+    INVALID("underflow", C(1), LP_OP_SIN, LP_OP_DROP, LP_OP_NEG);
+
+    // stack overflow
+    uint8_t code[LED_PROGRAM_SIZE_MAX];
+    memset(code, LP_OP_COLOR1, LED_PROGRAM_STACK_SIZE);
+    memset(code + LED_PROGRAM_STACK_SIZE, LP_OP_DROP, LED_PROGRAM_STACK_SIZE - 1);
+    check_load(&program, code, 2 * LED_PROGRAM_STACK_SIZE - 1, true, NULL);
+    code[LED_PROGRAM_STACK_SIZE] = LP_OP_DUP;
+    check_load(&program, code, 2 * LED_PROGRAM_STACK_SIZE - 1, false, "overflow");
+    code[LED_PROGRAM_STACK_SIZE] = LP_OP_COLOR2;
+    check_load(&program, code, 2 * LED_PROGRAM_STACK_SIZE - 1, false, "overflow");
+
+    // exactly one result
+    check_load(&program, code, 0, false, "0 values left");
+    INVALID("2 values left", LP_OP_COLOR1, LP_OP_COLOR2);
+    INVALID("0 values left", LP_OP_COLOR1, LP_OP_DROP);
+    VALID(LP_OP_COLOR1, LP_OP_COLOR2, LP_OP_DROP);
+
+    // the longest program
+    memset(code, LP_OP_NEG, sizeof(code));
+    code[0] = LP_OP_INDEX;
+    check_load(&program, code, LED_PROGRAM_SIZE_MAX, true, NULL);
+
+    // programs reading the time or the ride inputs are dynamic
+    const uint8_t inputs[] = {LP_OP_TIME, LP_OP_SPEED, LP_OP_DUTY, LP_OP_PITCH};
+    for (size_t i = 0; i < sizeof(inputs); ++i) {
+        check_load(&program, CODE(LP_OP_INDEX, inputs[i], LP_OP_ADD), true, NULL);
+        CHECK(program.dynamic, "input 0x%02x makes the program dynamic", inputs[i]);
+    }
+    VALID(LP_OP_INDEX, LP_OP_POS, LP_OP_LENGTH, LP_OP_DIV, LP_OP_ADD, LP_OP_HUE);
+    CHECK(!program.dynamic, "a static program isn't dynamic");
+}
+
+// Loads and runs the program for the LED at `index`.
+static uint32_t run(const uint8_t *code, uint8_t length, uint16_t index) {
+    LedProgram program = {0};
+    if (!program_load(&program, code, length)) {
+        CHECK(false, "program rejected: %s", last_message);
+        return 0;
+    }
+    return led_program_eval(&program, &ctx, index);
+}
+
+#define CHECK_RESULT(expected, ...)                                                                \
+    do {                                                                                           \
+        int32_t result = run(CODE(__VA_ARGS__), 3);                                                \
+        int32_t exp = (int32_t) (expected);                                                        \
+        CHECK(result == exp, "%s: %d, expected %d", #__VA_ARGS__, result, exp);                    \
+    } while (0)
+
+static void test_opcodes() {
+    // inputs
+    CHECK_RESULT(Q(1.5), C(1.5));
+    CHECK_RESULT(Q(-1), C(-1));
+    CHECK_RESULT(Q(-0.00390625), LP_OP_CONST, 0xFF, 0xFF);
+    CHECK_RESULT(Q(127.99609375), LP_OP_CONST, 0x7F, 0xFF);
+    CHECK_RESULT(ctx.time, LP_OP_TIME);
+    CHECK_RESULT(Q(3), LP_OP_INDEX);
+    CHECK_RESULT(3 * ctx.pos_step, LP_OP_POS);
+    CHECK_RESULT(ctx.length, LP_OP_LENGTH);
+    CHECK_RESULT(ctx.speed, LP_OP_SPEED);
+    CHECK_RESULT(ctx.duty, LP_OP_DUTY);
+    CHECK_RESULT(ctx.pitch, LP_OP_PITCH);
+
+    // binary operations, the first operand is pushed first
+    CHECK_RESULT(Q(1), C(2.5), C(-1.5), LP_OP_ADD);
+    CHECK_RESULT(Q(4), C(2.5), C(-1.5), LP_OP_SUB);
+    CHECK_RESULT(Q(-3.75), C(2.5), C(-1.5), LP_OP_MUL);
+    CHECK_RESULT(Q(-2.5), C(3.75), C(-1.5), LP_OP_DIV);
+    CHECK_RESULT(0, C(3.75), C(0), LP_OP_DIV);
+    CHECK_RESULT(Q(-1.5), C(2.5), C(-1.5), LP_OP_MIN);
+    CHECK_RESULT(Q(2.5), C(2.5), C(-1.5), LP_OP_MAX);
+    CHECK_RESULT(Q(1), C(-1.5), C(2.5), LP_OP_LT);
+    CHECK_RESULT(0, C(2.5), C(-1.5), LP_OP_LT);
+    CHECK_RESULT(0, C(2.5), C(2.5), LP_OP_LT);
+    CHECK_RESULT(Q(2), C(0.5), C(2), C(3), LP_OP_SELECT);
+    CHECK_RESULT(Q(3), C(0), C(2), C(3), LP_OP_SELECT);
+    CHECK_RESULT(Q(3), C(-1), C(2), C(3), LP_OP_SELECT);
+
+    // the additive operations wrap around, 127.5 * 255 + 3 * 127.5 = 32895
+    CHECK_RESULT(
+        (int32_t) (258u * Q(127.5)),
+        C(127.5),
+        LP_OP_DUP,
+        LP_OP_MUL,
+        C(2),
+        LP_OP_MUL,
+        C(127.5),
+        LP_OP_ADD,
+        C(127.5),
+        LP_OP_ADD,
+        C(127.5),
+        LP_OP_ADD
+    );
+
+    // unary operations
+    CHECK_RESULT(Q(-2.5), C(2.5), LP_OP_NEG);
+    CHECK_RESULT(Q(2.5), C(-2.5), LP_OP_ABS);
+    CHECK_RESULT(Q(2.5), C(2.5), LP_OP_ABS);
+    CHECK_RESULT(Q(0.25), C(2.25), LP_OP_FRAC);
+    CHECK_RESULT(Q(0.75), C(-2.25), LP_OP_FRAC);
+    CHECK_RESULT(0, C(-0.5), LP_OP_SAT);
+    CHECK_RESULT(Q(0.5), C(0.5), LP_OP_SAT);
+    CHECK_RESULT(Q(1), C(1.5), LP_OP_SAT);
+
+    // stack operations
+    CHECK_RESULT(Q(5), C(2.5), LP_OP_DUP, LP_OP_ADD);
+    CHECK_RESULT(Q(-4), C(2.5), C(-1.5), LP_OP_SWAP, LP_OP_SUB);
+    CHECK_RESULT(Q(2.5), C(2.5), C(-1.5), LP_OP_DROP);
+
+    // colors
+    CHECK_RESULT(hue_palette[0], C(0), LP_OP_HUE);
+    CHECK_RESULT(hue_palette[128], C(0.5), LP_OP_HUE);
+    CHECK_RESULT(hue_palette[64], C(1.25), LP_OP_HUE);
+    CHECK_RESULT(hue_palette[192], C(-0.25), LP_OP_HUE);
+    CHECK_RESULT(ctx.color1, LP_OP_COLOR1);
+    CHECK_RESULT(ctx.color2, LP_OP_COLOR2);
+    CHECK_RESULT(palette[0], LP_OP_PALETTE, 0);
+    const uint8_t last = LED_PROGRAM_PALETTE_SIZE - 1;
+    CHECK_RESULT(palette[last], LP_OP_PALETTE, last);
+    CHECK_RESULT(0xFF8000, C(1), C(0.5), C(0), LP_OP_RGB);
+    CHECK_RESULT(0x00FF40, C(-1), C(2), C(0.25), LP_OP_RGB);
+    CHECK_RESULT(
+        color_blend(ctx.color1, ctx.color2, 64), LP_OP_COLOR1, LP_OP_COLOR2, C(0.25), LP_OP_MIX
+    );
+    CHECK_RESULT(ctx.color1, LP_OP_COLOR1, LP_OP_COLOR2, C(-1), LP_OP_MIX);
+    CHECK_RESULT(ctx.color2, LP_OP_COLOR1, LP_OP_COLOR2, C(2), LP_OP_MIX);
+    CHECK_RESULT(0x081018, LP_OP_COLOR1, C(0.5), LP_OP_SCALE);
+    CHECK_RESULT(0, LP_OP_COLOR1, C(0), LP_OP_SCALE);
+    CHECK_RESULT(ctx.color1, LP_OP_COLOR1, C(1), LP_OP_SCALE);
+}
+
+// SIN over a full period and beyond, against sin() within 0.2%.
+static void test_sin() {
+    LedProgram program = {0};
+    // INDEX / 64 - 2 turns
+    check_load(
+        &program, CODE(LP_OP_INDEX, C(1.0 / 64), LP_OP_MUL, C(-2), LP_OP_ADD, LP_OP_SIN), true, NULL
+    );
+
+    for (uint16_t i = 0; i < 4 * 64; ++i) {
+        double turns = i / (double) 64 - 2;
+        int32_t result = led_program_eval(&program, &ctx, i);
+        double expected = sin(turns * 2 * M_PI);
+        CHECK(
+            fabs(result / (double) Q16_ONE - expected) < (double) 0.002,
+            "SIN(%f) is %f, expected %f",
+            turns,
+            result / (double) Q16_ONE,
+            expected
+        );
+    }
+
+    int32_t max = 0;
+    int32_t min = 0;
+    for (int32_t turns = -Q16_ONE; turns <= Q16_ONE; ++turns) {
+        int32_t y = q16_sin(turns);
+        max = y > max ? y : max;
+        min = y < min ? y : min;
+    }
+    CHECK(max <= Q16_ONE && min >= -Q16_ONE, "SIN is in [-1, 1]: [%d, %d]", min, max);
+}
+
+int main() {
+    host_vesc_if.printf = capture_printf;
+    for (uint32_t i = 0; i < LED_PROGRAM_PALETTE_SIZE; ++i) {
+        palette[i] = 0x102030 + i * 0x010101;
+    }
+
+    test_validator();
+    test_opcodes();
+    test_sin();
+    return test_result("led_program");
+}
@@ -0,0 +1,116 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+// Feeds the ride statistics hours of samples at the control loop rate and
+// checks the duration, the mean and the variance don't lose precision.
+
+#include "ride_stats.h"
+#include "test.h"
+
+#include "conf/buffer.h"
+#include "lib/utils.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOOP_RATE 800
+#define SAMPLE_COUNT (4000000)  // ~83 minutes
+
+static uint8_t response[SEND_BUF_MAX_SIZE];
+
+// the definitions for SEND_APP_DATA, in main.c in the package
+void send_app_data(unsigned char *buffer, unsigned int len) {
+    memcpy(response, buffer, len);
+}
+
+void fatal_error_terminate() {
+    abort();
+}
+
+// Checks the running statistics of a value with the given offset and
+// uniformly distributed noise against sums in long double.
+static void test_running_stats(float offset, float noise) {
+    RunningStats rs;
+    running_stats_reset(&rs);
+
+    long double sum = 0;
+    long double sum2 = 0;
+    for (uint32_t i = 0; i < SAMPLE_COUNT; ++i) {
+        float value = offset + (test_random() - 0.5f) * noise;
+        running_stats_update(&rs, value);
+        sum += value;
+        sum2 += (long double) value * value;
+    }
+
+    double mean = sum / SAMPLE_COUNT;
+    double variance = sum2 / SAMPLE_COUNT - (long double) mean * mean;
+    CHECK(
+        fabs(running_stats_mean(&rs) - mean) < (double) 1e-5 * (fabs(mean) + noise),
+        "mean of %g +- %g: %f, expected %f",
+        offset,
+        noise / 2,
+        running_stats_mean(&rs),
+        mean
+    );
+    CHECK(
+        fabs(running_stats_variance(&rs) - variance) < (double) 1e-4 * variance,
+        "variance of %g +- %g: %f, expected %f",
+        offset,
+        noise / 2,
+        running_stats_variance(&rs),
+        variance
+    );
+}
+
+static void test_duration() {
+    RideStats rs;
+    ride_stats_init(&rs);
+
+    State state = {0};
+    state.state = STATE_RUNNING;
+    MotorData motor = {0};
+
+    // alternating loop periods, like the measured ones
+    for (uint32_t i = 0; i < SAMPLE_COUNT; ++i) {
+        float dt = (i % 2 ? 1.1f : 0.9f) / LOOP_RATE;
+        ride_stats_update(&rs, &state, &motor, dt);
+    }
+
+    uint8_t request = 0;
+    ride_stats_request(&rs, &request, 1);
+
+    int32_t ind = 2;
+    float duration = buffer_get_float32_auto(response, &ind);
+    uint32_t sample_count = buffer_get_uint32(response, &ind);
+    double expected = SAMPLE_COUNT / (double) LOOP_RATE;
+    CHECK(sample_count == SAMPLE_COUNT, "sample count %u, expected %u", sample_count, SAMPLE_COUNT);
+    CHECK(
+        fabs(duration - expected) < (double) 1e-4 * expected,
+        "duration %f s, expected %f s",
+        duration,
+        expected
+    );
+}
+
+int main() {
+    test_running_stats(0.0f, 2.0f);
+    test_running_stats(20.0f, 10.0f);
+    test_running_stats(1000.0f, 1.0f);
+    test_duration();
+    return test_result("ride_stats");
+}
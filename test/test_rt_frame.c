@@ -0,0 +1,171 @@
+// Copyright 2026 Lukas Hrazky
+//
+// This file is part of the Refloat VESC package.
+//
+// Refloat VESC package is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Refloat VESC package is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <http://www.gnu.org/licenses/>.
+
+// Round trip of REALTIME_DATA delta frames through a reference decoder.
+
+#include "rt_frame.h"
+#include "test.h"
+
+#include "conf/buffer.h"
+
+#include <math.h>
+#include <string.h>
+
+#define ITEM_COUNT 64
+#define FRAME_COUNT 1000
+#define KEYFRAME_INTERVAL 30
+
+typedef struct {
+    bool used;
+    bool raw;
+    float quantum;
+} Item;
+
+static Item items[ITEM_COUNT];
+
+static void setup_items() {
+    for (uint8_t i = 0; i < ITEM_COUNT; ++i) {
+        // leave some items out of the masks, make a few of them raw
+        items[i].used = i % 7 != 3;
+        items[i].raw = i % 11 == 1;
+        items[i].quantum = (i % 4 + 1) * 0.05f;
+    }
+}
+
+// Writes a frame, raw items are a uint32 of the frame number and item index.
+static int32_t write_frame(
+    uint8_t *buffer, const float *values, uint32_t frame, bool f32, float *last_values, bool key
+) {
+    RtFrameWriter w;
+    rt_frame_begin(&w, buffer, 0, f32, last_values, key);
+    for (uint8_t i = 0; i < ITEM_COUNT; ++i) {
+        if (!items[i].used) {
+            continue;
+        }
+
+        if (items[i].raw) {
+            buffer_append_uint32(w.buffer, frame << 8 | i, &w.ind);
+            rt_frame_mark_raw(&w, i);
+        } else {
+            rt_frame_write_value(&w, i, values[i], items[i].quantum);
+        }
+    }
+    return rt_frame_end(&w);
+}
+
+// The client side: decodes a frame into values, returns the number of bytes read.
+static int32_t read_frame(
+    const uint8_t *buffer, float *values, uint32_t frame, bool f32, bool delta, bool key
+) {
+    int32_t ind = 0;
+    uint64_t changed = ~0ull;
+    if (delta) {
+        uint32_t changed1 = buffer_get_uint32(buffer, &ind);
+        uint32_t changed2 = buffer_get_uint32(buffer, &ind);
+        changed = (uint64_t) changed2 << 32 | changed1;
+    }
+
+    for (uint8_t i = 0; i < ITEM_COUNT; ++i) {
+        if (!items[i].used) {
+            CHECK(!(delta && changed & 1ull << i), "frame %u: unused item %u marked", frame, i);
+            continue;
+        }
+
+        bool marked = changed & 1ull << i;
+        CHECK(!items[i].raw || marked, "frame %u: raw item %u not marked", frame, i);
+        CHECK(!key || marked, "frame %u: keyframe item %u not marked", frame, i);
+        if (!marked) {
+            continue;
+        }
+
+        if (items[i].raw) {
+            uint32_t raw = buffer_get_uint32(buffer, &ind);
+            CHECK(raw == (frame << 8 | i), "frame %u: raw item %u: 0x%08x", frame, i, raw);
+        } else if (f32) {
+            values[i] = buffer_get_float32_auto(buffer, &ind);
+        } else {
+            values[i] = from_float16(buffer_get_uint16(buffer, &ind));
+        }
+    }
+    return ind;
+}
+
+static void test_round_trip(bool f32, bool delta) {
+    float values[ITEM_COUNT] = {0};
+    float last_values[ITEM_COUNT] = {0};
+    float decoded[ITEM_COUNT] = {0};
+    uint8_t buffer[8 + ITEM_COUNT * 4];
+
+    for (uint32_t frame = 0; frame < FRAME_COUNT; ++frame) {
+        for (uint8_t i = 0; i < ITEM_COUNT; ++i) {
+            // a mix of slowly drifting, jumping and constant values
+            float r = test_random();
+            if (i % 3 == 0) {
+                values[i] += (r - 0.5f) * items[i].quantum;
+            } else if (i % 3 == 1 && r < 0.1f) {
+                values[i] = (test_random() - 0.5f) * 2000.0f;
+            }
+        }
+
+        bool key = frame % KEYFRAME_INTERVAL == 0 || test_random() < 0.02f;
+        int32_t size =
+            write_frame(buffer, values, frame, f32, delta ? last_values : NULL, delta && key);
+        int32_t read = read_frame(buffer, decoded, frame, f32, delta, delta && key);
+        CHECK(read == size, "frame %u: read %d bytes of %d", frame, read, size);
+
+        for (uint8_t i = 0; i < ITEM_COUNT; ++i) {
+            if (!items[i].used || items[i].raw) {
+                continue;
+            }
+
+            // the client value is off by less than the quantum (plus the
+            // float16 precision), and exactly what the writer thinks it sent
+            float precision = f32 ? 0.0f : fabsf(values[i]) / 1024.0f + 1e-6f;
+            float max_error = delta ? items[i].quantum + precision : precision;
+            float error = fabsf(decoded[i] - values[i]);
+            CHECK(error <= max_error, "frame %u: item %u error %g", frame, i, (double) error);
+            if (delta) {
+                float sent = f32 ? last_values[i] : from_float16(to_float16(last_values[i]));
+                CHECK(decoded[i] == sent, "frame %u: item %u desynchronized", frame, i);
+            }
+        }
+    }
+}
+
+static void test_unchanged_frame() {
+    float values[ITEM_COUNT] = {0};
+    float last_values[ITEM_COUNT] = {0};
+    uint8_t buffer[8 + ITEM_COUNT * 4];
+
+    // with no change since the previous frame, only the raw items are sent
+    int32_t size = write_frame(buffer, values, 0, false, last_values, false);
+    int32_t raw_count = 0;
+    for (uint8_t i = 0; i < ITEM_COUNT; ++i) {
+        raw_count += items[i].used && items[i].raw;
+    }
+    CHECK(size == 8 + raw_count * 4, "unchanged delta frame size %d", size);
+}
+
+int main() {
+    setup_items();
+    test_round_trip(false, false);
+    test_round_trip(true, false);
+    test_round_trip(false, true);
+    test_round_trip(true, true);
+    test_unchanged_frame();
+    return test_result("rt_frame");
+}